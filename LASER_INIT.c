@@ -1,18 +1,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <stddef.h>
 #include "hardware/gpio.h"
 #include "hardware/adc.h"
+#include "hardware/flash.h"
+#include "hardware/watchdog.h"
 // Software AES implementation (no hardware dependency)
 #include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
 #include "pico/time.h"
 #include "pico/unique_id.h"
+#include "pico/flash.h"
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
+#include "lwip/udp.h"
 #include "lwip/dns.h"
 #include "lwip/err.h"
 #include "lwip/ip_addr.h"
+#include "particle_detector.h"
 
 // Define the GPIO pins for the laser modules
 #define LASER_PIN_1 2
@@ -31,24 +37,72 @@
 #define WIFI_SSID "HOST"
 #define WIFI_PASSWORD "abcd1111"
 
+// Link supervision and watchdog
+#define LINK_CONNECT_TIMEOUT_MS 20000   // Give up on one association attempt
+#define LINK_BACKOFF_MIN_MS 1000        // First retry delay, doubles on each failure
+#define LINK_BACKOFF_MAX_MS 60000
+#define LINK_POLL_INTERVAL_MS 250       // Link status check rate in the main loop
+#define UPLOAD_RETRY_MIN_MS 2000        // First retry after a failed POST, doubles on each failure
+#define UPLOAD_RETRY_MAX_MS 16000
+#define WATCHDOG_TIMEOUT_MS 8000        // Reset if the main loop stalls this long
+#define IDLE_BETWEEN_PERIODS_MS 30000   // Pause between counting periods
+
 // Server details
 #define SERVER_IP "192.168.76.164"
 #define SERVER_PORT 8000
 #define SERVER_PATH "/receive_data.php"
 
+// UDP telemetry (optional low-latency channel, no acknowledgement)
+#define UDP_TELEMETRY_ENABLED 1         // Set to 0 to use HTTP only
+#define UDP_TELEMETRY_PORT 8001         // Port of server/udp_receiver.php
+#define UDP_TICK_INTERVAL_MS 1000       // Running concentration update rate
+#define UDP_MAX_EVENTS_PER_TICK 20      // Further events in a tick are only counted (count_tick)
+#define UDP_MAGIC_0 'P'                 // Datagram header: "PC", version, type
+#define UDP_MAGIC_1 'C'
+#define UDP_PROTOCOL_VERSION 1
+#define UDP_HEADER_SIZE 12              // 4 byte header + 8 byte device ID
+#define UDP_MAX_PAYLOAD 256             // Keep datagrams well under one MTU
+
 // Encryption settings
 #define XTEA_KEY_SIZE 16
 #define XTEA_BLOCK_SIZE 8
+// Per-device secret key: 32 hex chars, same value as "key" for this device in
+// server/devices.json. Leave empty to derive the key from the board ID, which
+// is sent in cleartext and therefore only obscures the data.
+#define XTEA_DEVICE_KEY ""
 
 // Particle detection parameters
 #define CALIBRATION_SAMPLES 200         // Number of samples for stable baseline
 #define DETECTION_THRESHOLD_PERCENT 8   // 8% drop triggers particle detection
 #define MIN_PARTICLE_DURATION_MS 3      // Minimum event duration (filter noise)
 #define MAX_PARTICLE_DURATION_MS 100    // Maximum event duration (filter air bubbles)
+#define PILEUP_HYSTERESIS_PERCENT 3     // Recovery between dips that splits a merged event (0 = off)
+#define SATURATION_DEAD_TIME_PERCENT 50 // Dead time above this marks the result as saturated
 #define SAMPLING_RATE_MS 2              // Sample every 2ms for good resolution
 #define COUNTING_PERIOD_SEC 60          // Count particles for 60 seconds
 #define TRANSMISSION_INTERVAL_SEC 30    // Send results every 30 seconds
 
+// Adaptive counting: stop once the Poisson relative error (1/sqrt(N)) of
+// both sensors reaches the target, or when the maximum time is hit
+#define ADAPTIVE_COUNTING_ENABLED 1     // Set to 0 for fixed COUNTING_PERIOD_SEC
+#define TARGET_RELATIVE_ERROR_PERCENT 10 // 10% relative error = 100 counts
+#define MIN_COUNTING_PERIOD_SEC 5       // Never stop before this
+#define MAX_COUNTING_PERIOD_SEC 300     // Clean samples stop here
+#define CONFIDENCE_LEVEL_PERCENT 95     // Reported confidence intervals
+#define CONFIDENCE_Z 1.96f              // Normal quantile for CONFIDENCE_LEVEL_PERCENT
+// Fast boot: restore calibration from flash and validate it against live
+// samples instead of recalibrating (and waiting) on every reset
+#define CALIBRATION_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE) // Last sector
+#define CALIBRATION_FLASH_MAGIC 0x43414C31  // "CAL1"
+#define FAST_BOOT_VALIDATION_SAMPLES 50     // Samples per validation window (~100ms)
+#define FAST_BOOT_TOLERANCE_PERCENT 3       // Must stay well below DETECTION_THRESHOLD_PERCENT
+#define FAST_BOOT_MAX_WARMUP_MS 5000        // Give up and recalibrate after this
+#define BOOT_SERIAL_WAIT_MS 3000            // USB serial settle time (full boot only)
+#define BOOT_FIRST_COUNT_DELAY_MS 10000     // Pause before the first count (full boot only)
+
+#define ADAPTIVE_TARGET_COUNT ((uint32_t)((100.0f / TARGET_RELATIVE_ERROR_PERCENT) * \
+                                          (100.0f / TARGET_RELATIVE_ERROR_PERCENT) + 0.999f))
+
 // Simple XTEA encryption (lightweight and very secure)
 #define XTEA_KEY_SIZE 16
 #define XTEA_BLOCK_SIZE 8
@@ -56,6 +110,7 @@
 
 typedef struct {
     uint32_t key[4];
+    char device_id_hex[17]; // Sent as X-Device-ID so the server picks the key
     bool initialized;
 } xtea_context_t;
 
@@ -76,6 +131,7 @@ typedef struct {
     uint32_t sensor1_particle_count;
     uint32_t sensor2_particle_count;
     uint32_t counting_duration_sec;
+    uint32_t counting_duration_ms;     // Actual duration (adaptive mode varies)
     uint32_t start_timestamp;
     uint32_t end_timestamp;
     float sensor1_concentration_per_min;
@@ -86,20 +142,78 @@ typedef struct {
     uint32_t sensor2_false_positives;
     float avg_sensor1_voltage;         // Average during counting period
     float avg_sensor2_voltage;
+    float sensor1_ci_lower_per_min;    // Poisson confidence interval on concentration
+    float sensor1_ci_upper_per_min;
+    float sensor2_ci_lower_per_min;
+    float sensor2_ci_upper_per_min;
+    float sensor1_relative_error_percent;
+    float sensor2_relative_error_percent;
+    float sensor1_raw_concentration_per_min;  // Before dead-time correction
+    float sensor2_raw_concentration_per_min;
+    uint32_t sensor1_pileup_events;    // Merged events split into several particles
+    uint32_t sensor2_pileup_events;
+    float sensor1_dead_time_percent;   // Share of the period spent inside events
+    float sensor2_dead_time_percent;
+    bool saturated;                    // Dead time too high for a reliable correction
+    const char *termination_reason;    // "fixed", "precision" or "max_time"
     bool counting_active;
 } particle_count_data_t;
 
-// Event detection state for each sensor
+// Calibration record stored in the last flash sector
+typedef struct {
+    uint32_t magic;
+    float sensor1_baseline;
+    float sensor2_baseline;
+    float sensor1_noise_level;
+    float sensor2_noise_level;
+    uint32_t checksum;                 // Over all fields above
+} stored_calibration_t;
+
+// Boot timing, reported with every measurement
 typedef struct {
-    bool in_event;
-    uint32_t event_start_time;
-    float event_min_voltage;
-    float event_baseline;
-    uint32_t valid_events;
-    uint32_t false_positives;
-    float voltage_sum;                 // For calculating average
-    uint32_t voltage_samples;
-} detection_state_t;
+    bool fast_boot;                    // Calibration restored from flash
+    uint32_t wifi_connected_ms;        // Since boot, 0 = not yet
+    uint32_t first_count_ms;           // Since boot, start of first counting period
+} boot_stats_t;
+
+static boot_stats_t boot_stats = {0};
+
+// WiFi link supervisor
+typedef enum {
+    LINK_CONNECTING,                   // Association attempt in progress
+    LINK_UP,
+    LINK_BACKOFF                       // Waiting before the next attempt
+} link_state_t;
+
+typedef struct {
+    link_state_t state;
+    uint32_t state_since_ms;
+    uint32_t last_poll_ms;
+    uint32_t backoff_ms;
+    uint32_t next_attempt_ms;
+    uint32_t reconnect_attempts;
+    uint32_t transitions;
+    uint32_t outages;                  // Link lost after having been up
+    uint32_t outage_start_ms;          // 0 while up
+    uint32_t last_outage_ms;
+    uint32_t total_outage_ms;
+    uint32_t uploads_dropped;          // Results replaced by the next period before upload
+    uint32_t upload_failures;          // Failed POSTs (server down, timeout) while the link was up
+    bool watchdog_reset;               // Previous run was reset by the watchdog
+} link_supervisor_t;
+
+static link_supervisor_t link_supervisor = {0};
+static bool upload_pending = false;
+static uint32_t upload_retry_ms = UPLOAD_RETRY_MIN_MS;
+static uint32_t upload_next_attempt_ms = 0;
+
+// Detection parameters for particle_detector.c
+static const detector_config_t detector_config = {
+    DETECTION_THRESHOLD_PERCENT,
+    MIN_PARTICLE_DURATION_MS,
+    MAX_PARTICLE_DURATION_MS,
+    PILEUP_HYSTERESIS_PERCENT
+};
 
 // Global variables
 static calibration_data_t calibration = {0};
@@ -113,6 +227,7 @@ typedef struct {
     bool connected;
     bool data_sent;
     bool response_received;
+    bool failed;                       // Connection reset/refused; pcb already freed
     char *request_data;
     int request_len;
     char response_buffer[1024];
@@ -121,6 +236,26 @@ typedef struct {
 
 static tcp_client_t tcp_client;
 
+// UDP telemetry state
+typedef enum {
+    UDP_MSG_COUNT_TICK = 1,            // Running counts during a counting period
+    UDP_MSG_PARTICLE_EVENT = 2         // Single validated particle event
+} udp_msg_type_t;
+
+typedef struct {
+    struct udp_pcb *pcb;
+    ip_addr_t server_addr;
+    uint8_t device_id[8];
+    uint32_t next_seq;                 // Receiver uses gaps to measure loss
+    uint32_t datagrams_sent;
+    uint32_t send_errors;
+    uint32_t tick_events;              // particle_event datagrams since the last tick
+    uint32_t events_skipped;           // Events over UDP_MAX_EVENTS_PER_TICK (not sent)
+    bool ready;
+} udp_telemetry_t;
+
+static udp_telemetry_t udp_telemetry = {0};
+
 // Debug function to show device ID multiple ways
 void debug_device_id() {
     pico_unique_board_id_t board_id;
@@ -142,11 +277,11 @@ void debug_device_id() {
     }
     printf("\n");
     
-    printf("For PHP config: $DEVICE_ID = \"");
+    printf("For server/devices.json: \"");
     for (int i = 0; i < 8; i++) {
         printf("%02x", board_id.id[i]);
     }
-    printf("\";\n");
+    printf("\": {\"name\": \"...\"}\n");
     printf("================================\n");
     printf("\n");
 }
@@ -167,16 +302,46 @@ void xtea_encrypt_block(uint32_t* data, const uint32_t* key) {
     data[1] = v1;
 }
 
+// Parse XTEA_DEVICE_KEY (32 hex chars, big-endian words) into key
+static bool parse_device_key(const char* hex, uint32_t* key) {
+    if (strlen(hex) != XTEA_KEY_SIZE * 2) return false;
+    
+    for (int i = 0; i < XTEA_KEY_SIZE * 2; i++) {
+        char c = hex[i];
+        uint32_t nibble;
+        if (c >= '0' && c <= '9') nibble = c - '0';
+        else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+        else return false;
+        key[i / 8] = (key[i / 8] << 4) | nibble;
+    }
+    return true;
+}
+
 // Initialize XTEA encryption with device-specific key
 void init_xtea_encryption() {
     pico_unique_board_id_t board_id;
     pico_get_unique_board_id(&board_id);
     
-    // Generate 4 x 32-bit key from 8-byte board ID
-    crypto_ctx.key[0] = (board_id.id[0] << 24) | (board_id.id[1] << 16) | (board_id.id[2] << 8) | board_id.id[3];
-    crypto_ctx.key[1] = (board_id.id[4] << 24) | (board_id.id[5] << 16) | (board_id.id[6] << 8) | board_id.id[7];
-    crypto_ctx.key[2] = crypto_ctx.key[0] ^ 0xAAAAAAAA; // Add some variety
-    crypto_ctx.key[3] = crypto_ctx.key[1] ^ 0x55555555; // Add some variety
+    uint32_t secret_key[4] = {0};
+    if (parse_device_key(XTEA_DEVICE_KEY, secret_key)) {
+        memcpy(crypto_ctx.key, secret_key, sizeof(crypto_ctx.key));
+        printf("XTEA: using provisioned device key\n");
+    } else {
+        if (strlen(XTEA_DEVICE_KEY) > 0) {
+            printf("XTEA: XTEA_DEVICE_KEY is not 32 hex chars, falling back to board ID key\n");
+        }
+        
+        // Generate 4 x 32-bit key from 8-byte board ID
+        crypto_ctx.key[0] = (board_id.id[0] << 24) | (board_id.id[1] << 16) | (board_id.id[2] << 8) | board_id.id[3];
+        crypto_ctx.key[1] = (board_id.id[4] << 24) | (board_id.id[5] << 16) | (board_id.id[6] << 8) | board_id.id[7];
+        crypto_ctx.key[2] = crypto_ctx.key[0] ^ 0xAAAAAAAA; // Add some variety
+        crypto_ctx.key[3] = crypto_ctx.key[1] ^ 0x55555555; // Add some variety
+    }
+    
+    for (int i = 0; i < 8; i++) {
+        snprintf(&crypto_ctx.device_id_hex[i * 2], 3, "%02x", board_id.id[i]);
+    }
     
     crypto_ctx.initialized = true;
     
@@ -209,23 +374,11 @@ size_t unpad_data(uint8_t* data, size_t len) {
     return len - padding;
 }
 
-// Encrypt JSON data using XTEA
-bool encrypt_json_data(const char* json_data, uint8_t* encrypted_buffer, size_t* encrypted_len) {
-    if (!crypto_ctx.initialized) {
-        printf("Error: XTEA not initialized\n");
-        return false;
-    }
-    
-    size_t json_len = strlen(json_data);
-    if (json_len > 2000) { // Reasonable limit
-        printf("Error: JSON data too large for encryption\n");
-        return false;
-    }
-    
-    // Copy data to temporary buffer for padding
+// Pad and encrypt a raw buffer using XTEA, returns encrypted length
+size_t xtea_encrypt_buffer(const uint8_t* input, size_t len, uint8_t* output) {
     uint8_t padded_data[2048];
-    memcpy(padded_data, json_data, json_len);
-    size_t padded_len = json_len;
+    memcpy(padded_data, input, len);
+    size_t padded_len = len;
     
     // Add padding to make data block-aligned (8 bytes for XTEA)
     pad_data(padded_data, &padded_len);
@@ -244,17 +397,33 @@ bool encrypt_json_data(const char* json_data, uint8_t* encrypted_buffer, size_t*
         xtea_encrypt_block(block, crypto_ctx.key);
         
         // Convert back to bytes
-        encrypted_buffer[i] = block[0] & 0xFF;
-        encrypted_buffer[i + 1] = (block[0] >> 8) & 0xFF;
-        encrypted_buffer[i + 2] = (block[0] >> 16) & 0xFF;
-        encrypted_buffer[i + 3] = (block[0] >> 24) & 0xFF;
-        encrypted_buffer[i + 4] = block[1] & 0xFF;
-        encrypted_buffer[i + 5] = (block[1] >> 8) & 0xFF;
-        encrypted_buffer[i + 6] = (block[1] >> 16) & 0xFF;
-        encrypted_buffer[i + 7] = (block[1] >> 24) & 0xFF;
+        output[i] = block[0] & 0xFF;
+        output[i + 1] = (block[0] >> 8) & 0xFF;
+        output[i + 2] = (block[0] >> 16) & 0xFF;
+        output[i + 3] = (block[0] >> 24) & 0xFF;
+        output[i + 4] = block[1] & 0xFF;
+        output[i + 5] = (block[1] >> 8) & 0xFF;
+        output[i + 6] = (block[1] >> 16) & 0xFF;
+        output[i + 7] = (block[1] >> 24) & 0xFF;
+    }
+    
+    return padded_len;
+}
+
+// Encrypt JSON data using XTEA
+bool encrypt_json_data(const char* json_data, uint8_t* encrypted_buffer, size_t* encrypted_len) {
+    if (!crypto_ctx.initialized) {
+        printf("Error: XTEA not initialized\n");
+        return false;
     }
     
-    *encrypted_len = padded_len;
+    size_t json_len = strlen(json_data);
+    if (json_len > 2000) { // Reasonable limit
+        printf("Error: JSON data too large for encryption\n");
+        return false;
+    }
+    
+    *encrypted_len = xtea_encrypt_buffer((const uint8_t*)json_data, json_len, encrypted_buffer);
     printf("Encrypted %zu bytes of JSON data using XTEA\n", *encrypted_len);
     return true;
 }
@@ -277,6 +446,99 @@ void base64_encode(const uint8_t* data, size_t len, char* output) {
     output[j] = '\0';
 }
 
+// Simple FNV-1a checksum for the stored calibration record
+static uint32_t calibration_checksum(const stored_calibration_t *record) {
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < offsetof(stored_calibration_t, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+// Runs with the other core and interrupts locked out by flash_safe_execute()
+static void calibration_flash_write(void *param) {
+    flash_range_erase(CALIBRATION_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(CALIBRATION_FLASH_OFFSET, (const uint8_t *)param, FLASH_PAGE_SIZE);
+}
+
+// Persist the current calibration so the next boot can skip recalibrating
+bool save_calibration_to_flash() {
+    static uint8_t page[FLASH_PAGE_SIZE];
+    stored_calibration_t record = {
+        .magic = CALIBRATION_FLASH_MAGIC,
+        .sensor1_baseline = calibration.sensor1_baseline,
+        .sensor2_baseline = calibration.sensor2_baseline,
+        .sensor1_noise_level = calibration.sensor1_noise_level,
+        .sensor2_noise_level = calibration.sensor2_noise_level
+    };
+    record.checksum = calibration_checksum(&record);
+    
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &record, sizeof(record));
+    
+    if (flash_safe_execute(calibration_flash_write, page, UINT32_MAX) != PICO_OK) {
+        printf("Failed to store calibration in flash\n");
+        return false;
+    }
+    printf("Calibration stored in flash\n");
+    return true;
+}
+
+// Read the stored calibration, false if none or corrupted
+bool load_calibration_from_flash(stored_calibration_t *record) {
+    memcpy(record, (const void *)(XIP_BASE + CALIBRATION_FLASH_OFFSET), sizeof(*record));
+    return record->magic == CALIBRATION_FLASH_MAGIC &&
+           record->checksum == calibration_checksum(record) &&
+           record->sensor1_baseline > 0 && record->sensor2_baseline > 0;
+}
+
+// Check the stored baseline against live samples while the lasers warm up;
+// returns true as soon as one sampling window agrees with it
+bool validate_stored_calibration(const stored_calibration_t *record) {
+    const float conversion_factor = 3.3f / (1 << 12);
+    uint32_t start = to_ms_since_boot(get_absolute_time());
+    int windows = 0;
+    
+    printf("Validating stored calibration: S1=%.4fV, S2=%.4fV\n",
+           record->sensor1_baseline, record->sensor2_baseline);
+    
+    while (to_ms_since_boot(get_absolute_time()) - start < FAST_BOOT_MAX_WARMUP_MS) {
+        float sensor1_sum = 0, sensor2_sum = 0;
+        
+        watchdog_update();
+        for (int i = 0; i < FAST_BOOT_VALIDATION_SAMPLES; i++) {
+            adc_select_input(0);
+            sensor1_sum += adc_read() * conversion_factor;
+            adc_select_input(1);
+            sensor2_sum += adc_read() * conversion_factor;
+            sleep_ms(SAMPLING_RATE_MS);
+        }
+        windows++;
+        
+        float sensor1_mean = sensor1_sum / FAST_BOOT_VALIDATION_SAMPLES;
+        float sensor2_mean = sensor2_sum / FAST_BOOT_VALIDATION_SAMPLES;
+        float sensor1_error = fabsf(sensor1_mean - record->sensor1_baseline) * 100.0f / record->sensor1_baseline;
+        float sensor2_error = fabsf(sensor2_mean - record->sensor2_baseline) * 100.0f / record->sensor2_baseline;
+        
+        if (sensor1_error <= FAST_BOOT_TOLERANCE_PERCENT && sensor2_error <= FAST_BOOT_TOLERANCE_PERCENT) {
+            calibration.sensor1_baseline = record->sensor1_baseline;
+            calibration.sensor2_baseline = record->sensor2_baseline;
+            calibration.sensor1_noise_level = record->sensor1_noise_level;
+            calibration.sensor2_noise_level = record->sensor2_noise_level;
+            calibration.calibrated = true;
+            calibration.calibration_timestamp = to_ms_since_boot(get_absolute_time());
+            
+            printf("✅ Stored calibration valid after %d window(s): S1 %.1f%%, S2 %.1f%% off\n",
+                   windows, sensor1_error, sensor2_error);
+            return true;
+        }
+    }
+    
+    printf("⚠️  Stored calibration does not match live signal - recalibrating\n");
+    return false;
+}
+
 // Calibration function with noise analysis
 bool calibrate_sensors() {
     printf("\n=== PARTICLE COUNTER CALIBRATION ===\n");
@@ -311,6 +573,7 @@ bool calibrate_sensors() {
             fflush(stdout);
         }
         
+        watchdog_update();
         sleep_ms(25); // 25ms between samples for stable reading
     }
     
@@ -352,66 +615,103 @@ bool calibrate_sensors() {
         printf("✅ System stable - ready for particle detection\n");
     }
     
+    save_calibration_to_flash();
+    
     printf("=== READY FOR PARTICLE COUNTING ===\n\n");
     return true;
 }
 
-// Enhanced particle detection with duration analysis
+// Enhanced particle detection with duration and pile-up analysis
 bool detect_particle_event(uint8_t sensor_id, float current_voltage, detection_state_t *state) {
     if (!calibration.calibrated) return false;
     
     float baseline = (sensor_id == 1) ? calibration.sensor1_baseline : calibration.sensor2_baseline;
-    float threshold_voltage = baseline * (1.0f - DETECTION_THRESHOLD_PERCENT / 100.0f);
     uint32_t current_time = to_ms_since_boot(get_absolute_time());
+    bool was_in_event = state->in_event;
     
-    // Update running averages
-    state->voltage_sum += current_voltage;
-    state->voltage_samples++;
+    uint32_t particles = particle_detector_update(state, &detector_config, baseline,
+                                                  current_voltage, current_time);
+    if (!was_in_event || state->in_event) {
+        return false; // No event finished on this sample
+    }
     
-    if (!state->in_event && current_voltage < threshold_voltage) {
-        // Event started
-        state->in_event = true;
-        state->event_start_time = current_time;
-        state->event_min_voltage = current_voltage;
-        state->event_baseline = baseline;
-        return false; // Don't count yet
+    if (particles == 0) {
+        printf("False S%d: %lums (out of range)\n", sensor_id, state->last_event_duration_ms);
+        return false;
     }
     
-    if (state->in_event) {
-        // Update minimum voltage during event
-        if (current_voltage < state->event_min_voltage) {
-            state->event_min_voltage = current_voltage;
-        }
-        
-        if (current_voltage >= threshold_voltage) {
-            // Event ended - analyze duration
-            uint32_t duration = current_time - state->event_start_time;
-            float signal_drop = state->event_baseline - state->event_min_voltage;
-            float drop_percent = (signal_drop / state->event_baseline) * 100.0f;
-            
-            state->in_event = false;
-            
-            // Validate event duration and amplitude
-            if (duration >= MIN_PARTICLE_DURATION_MS && duration <= MAX_PARTICLE_DURATION_MS) {
-                state->valid_events++;
-                printf("PARTICLE S%d: %lums, %.1f%% drop, %.4fV amplitude\n",
-                       sensor_id, duration, drop_percent, signal_drop);
-                return true; // Valid particle detected
-            } else {
-                state->false_positives++;
-                printf("False S%d: %lums (out of range)\n", sensor_id, duration);
-                return false;
-            }
-        }
+    float signal_drop = baseline * state->last_event_drop_percent / 100.0f;
+    if (particles > 1) {
+        printf("PILE-UP S%d: %lu particles in %lums, %.1f%% max drop\n",
+               sensor_id, particles, state->last_event_duration_ms, state->last_event_drop_percent);
+    } else {
+        printf("PARTICLE S%d: %lums, %.1f%% drop, %.4fV amplitude\n",
+               sensor_id, state->last_event_duration_ms, state->last_event_drop_percent, signal_drop);
     }
+    return true; // Valid particle(s) detected
+}
+
+// Poisson confidence interval for an observed count (Byar's approximation
+// of the exact chi-square interval, usable down to zero counts)
+void poisson_confidence_interval(uint32_t count, float *lower, float *upper) {
+    const float z = CONFIDENCE_Z;
     
+    if (count == 0) {
+        *lower = 0.0f;
+    } else {
+        float n = (float)count;
+        float a = 1.0f - 1.0f / (9.0f * n) - z / (3.0f * sqrtf(n));
+        *lower = n * a * a * a;
+    }
+    
+    float n1 = (float)count + 1.0f;
+    float b = 1.0f - 1.0f / (9.0f * n1) + z / (3.0f * sqrtf(n1));
+    *upper = n1 * b * b * b;
+}
+
+// Relative standard error of a Poisson count in percent
+float poisson_relative_error_percent(uint32_t count) {
+    return count > 0 ? 100.0f / sqrtf((float)count) : 100.0f;
+}
+
+// Decide whether the current counting period is done
+bool counting_period_complete(uint32_t elapsed_ms) {
+#if ADAPTIVE_COUNTING_ENABLED
+    if (elapsed_ms >= MAX_COUNTING_PERIOD_SEC * 1000) {
+        count_data.termination_reason = "max_time";
+        return true;
+    }
+    if (elapsed_ms < MIN_COUNTING_PERIOD_SEC * 1000) {
+        return false;
+    }
+    
+    // Both sensors must reach the target precision
+    uint32_t limiting_count = sensor1_state.valid_events < sensor2_state.valid_events ?
+                              sensor1_state.valid_events : sensor2_state.valid_events;
+    if (limiting_count >= ADAPTIVE_TARGET_COUNT) {
+        count_data.termination_reason = "precision";
+        return true;
+    }
+    return false;
+#else
+    if (elapsed_ms >= COUNTING_PERIOD_SEC * 1000) {
+        count_data.termination_reason = "fixed";
+        return true;
+    }
     return false;
+#endif
 }
 
 // Initialize counting period
 void start_counting_period() {
     printf("\n=== STARTING PARTICLE COUNTING ===\n");
+#if ADAPTIVE_COUNTING_ENABLED
+    printf("Adaptive counting: target %d%% error (%lu counts/sensor), %d-%d seconds\n",
+           TARGET_RELATIVE_ERROR_PERCENT, ADAPTIVE_TARGET_COUNT,
+           MIN_COUNTING_PERIOD_SEC, MAX_COUNTING_PERIOD_SEC);
+#else
     printf("Counting period: %d seconds\n", COUNTING_PERIOD_SEC);
+#endif
     printf("Add your sample to the vessel now...\n\n");
     
     // Reset counting data
@@ -421,7 +721,13 @@ void start_counting_period() {
     
     count_data.counting_active = true;
     count_data.start_timestamp = to_ms_since_boot(get_absolute_time());
-    count_data.counting_duration_sec = COUNTING_PERIOD_SEC;
+    
+    if (boot_stats.first_count_ms == 0) {
+        boot_stats.first_count_ms = count_data.start_timestamp;
+        printf("Time to first count: %lu ms (%s boot)\n", boot_stats.first_count_ms,
+               boot_stats.fast_boot ? "fast" : "full");
+    }
+    count_data.termination_reason = "fixed";
     count_data.sensor1_baseline = calibration.sensor1_baseline;
     count_data.sensor2_baseline = calibration.sensor2_baseline;
 }
@@ -430,6 +736,8 @@ void start_counting_period() {
 void finalize_counting_period() {
     count_data.counting_active = false;
     count_data.end_timestamp = to_ms_since_boot(get_absolute_time());
+    count_data.counting_duration_ms = count_data.end_timestamp - count_data.start_timestamp;
+    count_data.counting_duration_sec = (count_data.counting_duration_ms + 500) / 1000;
     
     // Get final counts
     count_data.sensor1_particle_count = sensor1_state.valid_events;
@@ -445,19 +753,60 @@ void finalize_counting_period() {
         count_data.avg_sensor2_voltage = sensor2_state.voltage_sum / sensor2_state.voltage_samples;
     }
     
-    // Calculate concentration (particles per minute)
-    float actual_duration_min = count_data.counting_duration_sec / 60.0f;
-    count_data.sensor1_concentration_per_min = count_data.sensor1_particle_count / actual_duration_min;
-    count_data.sensor2_concentration_per_min = count_data.sensor2_particle_count / actual_duration_min;
+    // Calculate concentration (particles per minute) over the actual duration
+    float actual_duration_min = count_data.counting_duration_ms / 60000.0f;
+    if (actual_duration_min <= 0) actual_duration_min = 1.0f / 60000.0f;
+    count_data.sensor1_raw_concentration_per_min = count_data.sensor1_particle_count / actual_duration_min;
+    count_data.sensor2_raw_concentration_per_min = count_data.sensor2_particle_count / actual_duration_min;
+    
+    // Dead-time (pile-up) correction of the reported concentration
+    count_data.sensor1_concentration_per_min =
+        particle_detector_corrected_rate(&sensor1_state, count_data.counting_duration_ms) * 60000.0f;
+    count_data.sensor2_concentration_per_min =
+        particle_detector_corrected_rate(&sensor2_state, count_data.counting_duration_ms) * 60000.0f;
+    count_data.sensor1_pileup_events = sensor1_state.pileup_events;
+    count_data.sensor2_pileup_events = sensor2_state.pileup_events;
+    if (count_data.counting_duration_ms > 0) {
+        count_data.sensor1_dead_time_percent = sensor1_state.dead_time_ms * 100.0f / count_data.counting_duration_ms;
+        count_data.sensor2_dead_time_percent = sensor2_state.dead_time_ms * 100.0f / count_data.counting_duration_ms;
+    }
+    count_data.saturated = count_data.sensor1_dead_time_percent >= SATURATION_DEAD_TIME_PERCENT ||
+                           count_data.sensor2_dead_time_percent >= SATURATION_DEAD_TIME_PERCENT;
+    
+    // Confidence intervals on the counts, scaled to (corrected) concentration
+    float lower, upper;
+    float correction1 = count_data.sensor1_particle_count > 0 ?
+        count_data.sensor1_concentration_per_min / count_data.sensor1_raw_concentration_per_min : 1.0f;
+    float correction2 = count_data.sensor2_particle_count > 0 ?
+        count_data.sensor2_concentration_per_min / count_data.sensor2_raw_concentration_per_min : 1.0f;
+    poisson_confidence_interval(count_data.sensor1_particle_count, &lower, &upper);
+    count_data.sensor1_ci_lower_per_min = lower * correction1 / actual_duration_min;
+    count_data.sensor1_ci_upper_per_min = upper * correction1 / actual_duration_min;
+    poisson_confidence_interval(count_data.sensor2_particle_count, &lower, &upper);
+    count_data.sensor2_ci_lower_per_min = lower * correction2 / actual_duration_min;
+    count_data.sensor2_ci_upper_per_min = upper * correction2 / actual_duration_min;
+    count_data.sensor1_relative_error_percent = poisson_relative_error_percent(count_data.sensor1_particle_count);
+    count_data.sensor2_relative_error_percent = poisson_relative_error_percent(count_data.sensor2_particle_count);
     
     printf("\n=== COUNTING COMPLETE ===\n");
-    printf("Duration: %lu seconds\n", count_data.counting_duration_sec);
-    printf("Sensor 1: %lu particles (%.1f/min)\n", 
-           count_data.sensor1_particle_count, count_data.sensor1_concentration_per_min);
-    printf("Sensor 2: %lu particles (%.1f/min)\n", 
-           count_data.sensor2_particle_count, count_data.sensor2_concentration_per_min);
+    printf("Duration: %lu.%03lu seconds (%s)\n", count_data.counting_duration_ms / 1000,
+           count_data.counting_duration_ms % 1000, count_data.termination_reason);
+    printf("Sensor 1: %lu particles (%.1f/min, %d%% CI %.1f-%.1f, +/-%.1f%%)\n", 
+           count_data.sensor1_particle_count, count_data.sensor1_concentration_per_min,
+           CONFIDENCE_LEVEL_PERCENT, count_data.sensor1_ci_lower_per_min,
+           count_data.sensor1_ci_upper_per_min, count_data.sensor1_relative_error_percent);
+    printf("Sensor 2: %lu particles (%.1f/min, %d%% CI %.1f-%.1f, +/-%.1f%%)\n", 
+           count_data.sensor2_particle_count, count_data.sensor2_concentration_per_min,
+           CONFIDENCE_LEVEL_PERCENT, count_data.sensor2_ci_lower_per_min,
+           count_data.sensor2_ci_upper_per_min, count_data.sensor2_relative_error_percent);
     printf("False positives: S1=%lu, S2=%lu\n", 
            count_data.sensor1_false_positives, count_data.sensor2_false_positives);
+    printf("Pile-up: S1=%lu split events, %.1f%% dead time; S2=%lu split events, %.1f%% dead time\n",
+           count_data.sensor1_pileup_events, count_data.sensor1_dead_time_percent,
+           count_data.sensor2_pileup_events, count_data.sensor2_dead_time_percent);
+    if (count_data.saturated) {
+        printf("⚠️  WARNING: Detector saturated - dilute the sample for accurate counts\n");
+    }
     printf("Average voltages: S1=%.3fV, S2=%.3fV\n",
            count_data.avg_sensor1_voltage, count_data.avg_sensor2_voltage);
     printf("========================\n\n");
@@ -500,8 +849,12 @@ static err_t tcp_client_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, er
 
 static void tcp_client_err(void *arg, err_t err) {
     tcp_client_t *client = (tcp_client_t*)arg;
+    // lwIP has freed the pcb before calling this: never touch it again
+    client->tcp_pcb = NULL;
     if (err == -13) {
         client->response_received = true;
+    } else {
+        client->failed = true;
     }
     client->connected = false;
 }
@@ -525,60 +878,98 @@ bool send_encrypted_http_post(const uint8_t* encrypted_data, size_t encrypted_le
         "Connection: close\r\n"
         "User-Agent: PicoW-ParticleCounter/1.0\r\n"
         "X-Encryption: XTEA-64\r\n"
+        "X-Device-ID: %s\r\n"
         "\r\n"
         "%s",
-        SERVER_PATH, SERVER_IP, SERVER_PORT, content_length, base64_data);
+        SERVER_PATH, SERVER_IP, SERVER_PORT, content_length, crypto_ctx.device_id_hex, base64_data);
     
     tcp_client.request_data = http_request;
     tcp_client.request_len = strlen(http_request);
     
+    ip_addr_t server_addr;
+    if (!ip4addr_aton(SERVER_IP, &server_addr)) return false;
+    
+    // lwIP callbacks run in the background (threadsafe_background): every
+    // tcp_* call from here must hold the lwIP lock
+    cyw43_arch_lwip_begin();
     struct tcp_pcb *pcb = tcp_new();
-    if (pcb == NULL) return false;
+    if (pcb == NULL) {
+        cyw43_arch_lwip_end();
+        return false;
+    }
     
     tcp_client.tcp_pcb = pcb;
     tcp_arg(pcb, &tcp_client);
     tcp_err(pcb, tcp_client_err);
     tcp_recv(pcb, tcp_client_recv);
     
-    ip_addr_t server_addr;
-    if (!ip4addr_aton(SERVER_IP, &server_addr)) {
-        tcp_close(pcb);
-        return false;
-    }
-    
     err_t err = tcp_connect(pcb, &server_addr, SERVER_PORT, tcp_client_connected);
     if (err != ERR_OK) {
+        tcp_client.tcp_pcb = NULL;
+        tcp_err(pcb, NULL);
         tcp_close(pcb);
+        cyw43_arch_lwip_end();
         return false;
     }
+    cyw43_arch_lwip_end();
     
+    // A refused or reset connection ends the wait at once
     int timeout = 0;
-    while (!tcp_client.response_received && timeout < 100) {
+    while (!tcp_client.response_received && !tcp_client.failed && timeout < 100) {
+        watchdog_update(); // Bounded wait; a hung lwIP call never gets here
         sleep_ms(100);
         cyw43_arch_poll();
         timeout++;
     }
     
+    cyw43_arch_lwip_begin();
     if (tcp_client.tcp_pcb) {
-        tcp_close(tcp_client.tcp_pcb);
+        // Detach first so a late error/abort no longer reaches tcp_client
+        pcb = tcp_client.tcp_pcb;
+        tcp_client.tcp_pcb = NULL;
+        tcp_arg(pcb, NULL);
+        tcp_err(pcb, NULL);
+        tcp_recv(pcb, NULL);
+        if (tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+        }
     }
+    bool received = tcp_client.response_received;
+    cyw43_arch_lwip_end();
     
-    return tcp_client.response_received;
+    return received;
 }
 
 // Send particle counting results to server (now encrypted)
 bool send_particle_count_data() {
-    char json_payload[1024];
+    char json_payload[2000];
     
     snprintf(json_payload, sizeof(json_payload),
         "{"
         "\"type\":\"particle_count\","
         "\"timestamp\":%lu,"
         "\"counting_duration_sec\":%lu,"
+        "\"counting_duration_ms\":%lu,"
+        "\"adaptive_counting\":%s,"
+        "\"termination_reason\":\"%s\","
         "\"sensor1_particles\":%lu,"
         "\"sensor2_particles\":%lu,"
         "\"sensor1_concentration_per_min\":%.2f,"
         "\"sensor2_concentration_per_min\":%.2f,"
+        "\"confidence_level_percent\":%d,"
+        "\"sensor1_ci_lower_per_min\":%.2f,"
+        "\"sensor1_ci_upper_per_min\":%.2f,"
+        "\"sensor2_ci_lower_per_min\":%.2f,"
+        "\"sensor2_ci_upper_per_min\":%.2f,"
+        "\"sensor1_relative_error_percent\":%.1f,"
+        "\"sensor2_relative_error_percent\":%.1f,"
+        "\"sensor1_raw_concentration_per_min\":%.2f,"
+        "\"sensor2_raw_concentration_per_min\":%.2f,"
+        "\"sensor1_pileup_events\":%lu,"
+        "\"sensor2_pileup_events\":%lu,"
+        "\"sensor1_dead_time_percent\":%.1f,"
+        "\"sensor2_dead_time_percent\":%.1f,"
+        "\"saturated\":%s,"
         "\"sensor1_baseline\":%.4f,"
         "\"sensor2_baseline\":%.4f,"
         "\"avg_sensor1_voltage\":%.4f,"
@@ -587,14 +978,44 @@ bool send_particle_count_data() {
         "\"sensor2_false_positives\":%lu,"
         "\"detection_threshold_percent\":%d,"
         "\"calibrated\":%s,"
+        "\"fast_boot\":%s,"
+        "\"time_to_first_count_ms\":%lu,"
+        "\"wifi_connected_ms\":%lu,"
+        "\"watchdog_reset\":%s,"
+        "\"link_transitions\":%lu,"
+        "\"link_outages\":%lu,"
+        "\"last_outage_ms\":%lu,"
+        "\"total_outage_ms\":%lu,"
+        "\"reconnect_attempts\":%lu,"
+        "\"uploads_dropped\":%lu,"
+        "\"upload_failures\":%lu,"
+        "\"udp_datagrams_sent\":%lu,"
+        "\"udp_next_seq\":%lu,"
         "\"measurement_quality\":\"%.1f%%\""
         "}",
         count_data.end_timestamp,
         count_data.counting_duration_sec,
+        count_data.counting_duration_ms,
+        ADAPTIVE_COUNTING_ENABLED ? "true" : "false",
+        count_data.termination_reason,
         count_data.sensor1_particle_count,
         count_data.sensor2_particle_count,
         count_data.sensor1_concentration_per_min,
         count_data.sensor2_concentration_per_min,
+        CONFIDENCE_LEVEL_PERCENT,
+        count_data.sensor1_ci_lower_per_min,
+        count_data.sensor1_ci_upper_per_min,
+        count_data.sensor2_ci_lower_per_min,
+        count_data.sensor2_ci_upper_per_min,
+        count_data.sensor1_relative_error_percent,
+        count_data.sensor2_relative_error_percent,
+        count_data.sensor1_raw_concentration_per_min,
+        count_data.sensor2_raw_concentration_per_min,
+        count_data.sensor1_pileup_events,
+        count_data.sensor2_pileup_events,
+        count_data.sensor1_dead_time_percent,
+        count_data.sensor2_dead_time_percent,
+        count_data.saturated ? "true" : "false",
         count_data.sensor1_baseline,
         count_data.sensor2_baseline,
         count_data.avg_sensor1_voltage,
@@ -603,6 +1024,19 @@ bool send_particle_count_data() {
         count_data.sensor2_false_positives,
         DETECTION_THRESHOLD_PERCENT,
         calibration.calibrated ? "true" : "false",
+        boot_stats.fast_boot ? "true" : "false",
+        boot_stats.first_count_ms,
+        boot_stats.wifi_connected_ms,
+        link_supervisor.watchdog_reset ? "true" : "false",
+        link_supervisor.transitions,
+        link_supervisor.outages,
+        link_supervisor.last_outage_ms,
+        link_supervisor.total_outage_ms,
+        link_supervisor.reconnect_attempts,
+        link_supervisor.uploads_dropped,
+        link_supervisor.upload_failures,
+        udp_telemetry.datagrams_sent,
+        udp_telemetry.next_seq,
         // Simple quality metric: ratio of valid to total events
         (count_data.sensor1_particle_count + count_data.sensor2_particle_count) > 0 ?
         (float)(count_data.sensor1_particle_count + count_data.sensor2_particle_count) * 100.0f /
@@ -625,27 +1059,302 @@ bool send_particle_count_data() {
     return send_encrypted_http_post(encrypted_data, encrypted_len);
 }
 
-// Connect to WiFi
-bool connect_to_wifi() {
+// Open the UDP telemetry socket (raw lwIP API, fire-and-forget)
+bool init_udp_telemetry() {
+    memset(&udp_telemetry, 0, sizeof(udp_telemetry));
+    
+    pico_unique_board_id_t board_id;
+    pico_get_unique_board_id(&board_id);
+    memcpy(udp_telemetry.device_id, board_id.id, sizeof(udp_telemetry.device_id));
+    
+    if (!ip4addr_aton(SERVER_IP, &udp_telemetry.server_addr)) {
+        printf("UDP telemetry: invalid server address\n");
+        return false;
+    }
+    
+    cyw43_arch_lwip_begin();
+    udp_telemetry.pcb = udp_new();
+    cyw43_arch_lwip_end();
+    
+    if (udp_telemetry.pcb == NULL) {
+        printf("UDP telemetry: failed to allocate PCB\n");
+        return false;
+    }
+    
+    udp_telemetry.ready = true;
+    printf("UDP telemetry enabled: %s:%d\n", SERVER_IP, UDP_TELEMETRY_PORT);
+    return true;
+}
+
+// Encrypt and send one telemetry datagram; the body is a JSON object
+// without its closing brace, seq/timestamp are appended here
+bool send_udp_telemetry(udp_msg_type_t msg_type, const char* json_body) {
+    if (!udp_telemetry.ready || !crypto_ctx.initialized) return false;
+    
+    char json[UDP_MAX_PAYLOAD];
+    int json_len = snprintf(json, sizeof(json), "%s,\"seq\":%lu,\"ts\":%lu}",
+                            json_body, udp_telemetry.next_seq,
+                            to_ms_since_boot(get_absolute_time()));
+    if (json_len < 0 || json_len >= (int)sizeof(json) - XTEA_BLOCK_SIZE) {
+        udp_telemetry.send_errors++;
+        return false;
+    }
+    
+    // Header is sent in the clear so the receiver can pick the key
+    uint8_t datagram[UDP_HEADER_SIZE + UDP_MAX_PAYLOAD];
+    datagram[0] = UDP_MAGIC_0;
+    datagram[1] = UDP_MAGIC_1;
+    datagram[2] = UDP_PROTOCOL_VERSION;
+    datagram[3] = (uint8_t)msg_type;
+    memcpy(datagram + 4, udp_telemetry.device_id, 8);
+    
+    size_t encrypted_len = xtea_encrypt_buffer((const uint8_t*)json, json_len,
+                                               datagram + UDP_HEADER_SIZE);
+    uint16_t total_len = UDP_HEADER_SIZE + encrypted_len;
+    
+    // Sequence number is consumed even if the send fails, so local
+    // errors show up as gaps on the receiver just like network loss
+    udp_telemetry.next_seq++;
+    
+    cyw43_arch_lwip_begin();
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, total_len, PBUF_RAM);
+    err_t err = ERR_MEM;
+    if (p != NULL) {
+        memcpy(p->payload, datagram, total_len);
+        err = udp_sendto(udp_telemetry.pcb, p, &udp_telemetry.server_addr, UDP_TELEMETRY_PORT);
+        pbuf_free(p);
+    }
+    cyw43_arch_lwip_end();
+    
+    if (err != ERR_OK) {
+        udp_telemetry.send_errors++;
+        return false;
+    }
+    
+    udp_telemetry.datagrams_sent++;
+    return true;
+}
+
+// Push running counts for the current counting period
+void send_udp_count_tick(uint32_t elapsed_ms) {
+    char body[192];
+    float elapsed_min = elapsed_ms / 60000.0f;
+    if (elapsed_min <= 0) elapsed_min = 1.0f / 60000.0f;
+    
+    snprintf(body, sizeof(body),
+        "{\"type\":\"count_tick\","
+        "\"elapsed_ms\":%lu,"
+        "\"s1\":%lu,\"s2\":%lu,"
+        "\"s1_per_min\":%.2f,\"s2_per_min\":%.2f,"
+        "\"events_skipped\":%lu",
+        elapsed_ms,
+        sensor1_state.valid_events, sensor2_state.valid_events,
+        sensor1_state.valid_events / elapsed_min,
+        sensor2_state.valid_events / elapsed_min,
+        udp_telemetry.events_skipped);
+    
+    send_udp_telemetry(UDP_MSG_COUNT_TICK, body);
+    udp_telemetry.tick_events = 0;
+}
+
+// Push a single validated particle event. Runs inside the sampling loop, so
+// at high rates only the first UDP_MAX_EVENTS_PER_TICK events of each tick
+// are sent; the rest are in the counts of the next count_tick. Skipped
+// events use no sequence number and do not show up as loss.
+void send_udp_particle_event(uint8_t sensor_id, const detection_state_t *state) {
+    if (udp_telemetry.tick_events >= UDP_MAX_EVENTS_PER_TICK) {
+        udp_telemetry.events_skipped++;
+        return;
+    }
+    udp_telemetry.tick_events++;
+    
+    char body[160];
+    snprintf(body, sizeof(body),
+        "{\"type\":\"particle_event\","
+        "\"sensor\":%d,"
+        "\"duration_ms\":%lu,"
+        "\"drop_percent\":%.1f,"
+        "\"particles\":%lu,"
+        "\"count\":%lu",
+        sensor_id, state->last_event_duration_ms,
+        state->last_event_drop_percent, state->last_event_particles,
+        state->valid_events);
+    
+    send_udp_telemetry(UDP_MSG_PARTICLE_EVENT, body);
+}
+
+// Start joining WiFi in the background; association and DHCP proceed
+// while the lasers warm up and the calibration is checked
+bool start_wifi_connect() {
     cyw43_arch_enable_sta_mode();
     
-    printf("Connecting to WiFi: %s\n", WIFI_SSID);
-    if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, 
-                                           CYW43_AUTH_WPA2_AES_PSK, 30000)) {
-        printf("Failed to connect to WiFi\n");
+    printf("Connecting to WiFi (async): %s\n", WIFI_SSID);
+    if (cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK)) {
+        printf("Failed to start WiFi connection\n");
+        return false;
+    }
+    return true;
+}
+
+// Non-blocking link check, records when the link first came up
+bool wifi_link_up() {
+    if (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_UP) {
         return false;
     }
     
-    printf("Connected to WiFi successfully!\n");
-    printf("IP Address: %s\n", ip4addr_ntoa(netif_ip4_addr(netif_list)));
+    if (boot_stats.wifi_connected_ms == 0) {
+        boot_stats.wifi_connected_ms = to_ms_since_boot(get_absolute_time());
+        printf("Connected to WiFi successfully! (%lu ms after boot)\n", boot_stats.wifi_connected_ms);
+        printf("IP Address: %s\n", ip4addr_ntoa(netif_ip4_addr(netif_list)));
+    }
     return true;
 }
 
+static const char *link_state_name(link_state_t state) {
+    switch (state) {
+        case LINK_CONNECTING: return "CONNECTING";
+        case LINK_UP: return "UP";
+        default: return "BACKOFF";
+    }
+}
+
+static void set_link_state(link_state_t state, uint32_t now) {
+    printf("LINK: %s -> %s\n", link_state_name(link_supervisor.state), link_state_name(state));
+    link_supervisor.state = state;
+    link_supervisor.state_since_ms = now;
+    link_supervisor.transitions++;
+}
+
+// Drop any stale association and start a new background join
+static void start_link_attempt(uint32_t now) {
+    link_supervisor.reconnect_attempts++;
+    printf("Reconnecting to WiFi (attempt %lu)...\n", link_supervisor.reconnect_attempts);
+    
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    if (cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK)) {
+        link_supervisor.next_attempt_ms = now + link_supervisor.backoff_ms;
+        set_link_state(LINK_BACKOFF, now);
+        return;
+    }
+    set_link_state(LINK_CONNECTING, now);
+}
+
+// Start supervising the join started by start_wifi_connect()
+void init_link_supervisor() {
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    link_supervisor.watchdog_reset = watchdog_enable_caused_reboot(); // Not set by watchdog_reboot()
+    link_supervisor.state = LINK_CONNECTING;
+    link_supervisor.state_since_ms = now;
+    link_supervisor.backoff_ms = LINK_BACKOFF_MIN_MS;
+    
+    if (link_supervisor.watchdog_reset) {
+        printf("⚠️  Previous run was reset by the watchdog\n");
+    }
+}
+
+// Non-blocking link monitor, called from the main loop. Reassociates with
+// exponential backoff and tracks outage durations for telemetry.
+void link_supervisor_poll(uint32_t now) {
+    if (now - link_supervisor.last_poll_ms < LINK_POLL_INTERVAL_MS) return;
+    link_supervisor.last_poll_ms = now;
+    
+    int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+    
+    switch (link_supervisor.state) {
+        case LINK_UP:
+            if (status != CYW43_LINK_UP) {
+                printf("⚠️  WiFi link lost (status %d) - counting continues offline\n", status);
+                link_supervisor.outages++;
+                link_supervisor.outage_start_ms = now;
+                link_supervisor.backoff_ms = LINK_BACKOFF_MIN_MS;
+                start_link_attempt(now);
+            }
+            break;
+            
+        case LINK_CONNECTING:
+            if (status == CYW43_LINK_UP) {
+                wifi_link_up(); // Logs IP and first-connect time
+                if (link_supervisor.outage_start_ms != 0) {
+                    link_supervisor.last_outage_ms = now - link_supervisor.outage_start_ms;
+                    link_supervisor.total_outage_ms += link_supervisor.last_outage_ms;
+                    link_supervisor.outage_start_ms = 0;
+                    printf("WiFi link restored after %lu ms\n", link_supervisor.last_outage_ms);
+                }
+                link_supervisor.backoff_ms = LINK_BACKOFF_MIN_MS;
+                set_link_state(LINK_UP, now);
+            } else if (status == CYW43_LINK_FAIL || status == CYW43_LINK_NONET ||
+                       status == CYW43_LINK_BADAUTH ||
+                       now - link_supervisor.state_since_ms >= LINK_CONNECT_TIMEOUT_MS) {
+                printf("WiFi join failed (status %d), retrying in %lu ms\n",
+                       status, link_supervisor.backoff_ms);
+                link_supervisor.next_attempt_ms = now + link_supervisor.backoff_ms;
+                link_supervisor.backoff_ms *= 2;
+                if (link_supervisor.backoff_ms > LINK_BACKOFF_MAX_MS) {
+                    link_supervisor.backoff_ms = LINK_BACKOFF_MAX_MS;
+                }
+                set_link_state(LINK_BACKOFF, now);
+            }
+            break;
+            
+        case LINK_BACKOFF:
+            if ((int32_t)(now - link_supervisor.next_attempt_ms) >= 0) {
+                start_link_attempt(now);
+            }
+            break;
+    }
+}
+
+// Upload the last result once the link is up; false while still pending.
+// A failed POST keeps the result pending and retries with backoff until the
+// next counting period replaces it.
+bool try_pending_upload() {
+    if (!upload_pending || link_supervisor.state != LINK_UP) return false;
+    
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if ((int32_t)(now - upload_next_attempt_ms) < 0) return false;
+    
+    if (send_particle_count_data()) {
+        printf("Encrypted particle count data transmitted successfully!\n");
+        upload_pending = false;
+        upload_retry_ms = UPLOAD_RETRY_MIN_MS;
+        return true;
+    }
+    
+    link_supervisor.upload_failures++;
+    printf("Failed to transmit encrypted particle count data, retrying in %lu ms\n", upload_retry_ms);
+    upload_next_attempt_ms = to_ms_since_boot(get_absolute_time()) + upload_retry_ms;
+    upload_retry_ms *= 2;
+    if (upload_retry_ms > UPLOAD_RETRY_MAX_MS) {
+        upload_retry_ms = UPLOAD_RETRY_MAX_MS;
+    }
+    return false;
+}
+
+// Wait between counting periods while supervising the link
+void idle_with_supervision(uint32_t duration_ms) {
+    uint32_t start = to_ms_since_boot(get_absolute_time());
+    uint32_t now = start;
+    
+    while (now - start < duration_ms) {
+        watchdog_update();
+        link_supervisor_poll(now);
+        try_pending_upload();
+        sleep_ms(100);
+        now = to_ms_since_boot(get_absolute_time());
+    }
+}
+
 int main() {
     stdio_init_all();
     
+    // A valid stored calibration enables the fast boot path
+    stored_calibration_t stored_calibration;
+    boot_stats.fast_boot = load_calibration_from_flash(&stored_calibration);
+    
     // Give extra time for USB serial connection to initialize
-    sleep_ms(3000);
+    if (!boot_stats.fast_boot) {
+        sleep_ms(BOOT_SERIAL_WAIT_MS);
+    }
     
     printf("\n\n");
     printf("======================================\n");
@@ -663,19 +1372,19 @@ int main() {
         printf("%02x", test_board_id.id[i]);
     }
     printf("\n");
-    printf("Copy this to PHP: $DEVICE_ID = \"");
+    printf("Add this to server/devices.json: \"");
     for (int i = 0; i < 8; i++) {
         printf("%02x", test_board_id.id[i]);
     }
-    printf("\";\n");
+    printf("\": {\"name\": \"...\"}\n");
     printf("======================================\n");
     
-    printf("Waiting for systems to initialize...\n");
-    sleep_ms(2000);
-    
     if (cyw43_arch_init()) {
-        printf("Wi-Fi init failed\n");
-        return -1;
+        printf("Wi-Fi init failed - rebooting\n");
+        watchdog_reboot(0, 0, 1000);
+        while (1) {
+            tight_loop_contents();
+        }
     }
     
     printf("Wi-Fi module initialized OK\n");
@@ -707,33 +1416,44 @@ int main() {
     printf("Raspberry Pi Pico 2W Particle Counter System\n");
     printf("==========================================\n");
     printf("🔒 XTEA Encryption Enabled\n");
+    printf("Boot mode: %s\n", boot_stats.fast_boot ? "FAST (stored calibration)" : "FULL");
     
-    sleep_ms(2000);
-    
-    // Connect to WiFi
-    if (!connect_to_wifi()) {
-        printf("Cannot continue without WiFi connection\n");
-        return -1;
+    // Join WiFi in the background while the lasers warm up
+    if (!start_wifi_connect()) {
+        printf("Continuing without WiFi - results will not be uploaded\n");
     }
     
+    init_link_supervisor();
+    
+#if UDP_TELEMETRY_ENABLED
+    init_udp_telemetry();
+#endif
+    
     printf("Turning on lasers...\n");
     gpio_put(LASER_PIN_1, 1);
     gpio_put(LASER_PIN_2, 1);
     printf("Both lasers are ON\n");
     
-    sleep_ms(3000);
-    
-    // Initial calibration
-    calibrate_sensors();
+    // Stored calibration is validated during warm-up; otherwise recalibrate
+    if (!boot_stats.fast_boot || !validate_stored_calibration(&stored_calibration)) {
+        boot_stats.fast_boot = false;
+        sleep_ms(3000); // Laser warm-up
+        calibrate_sensors();
+    }
     
     printf("System ready for particle counting\n");
     printf("Press calibration button (GPIO 14) to recalibrate\n");
-    printf("Starting first counting period in 10 seconds...\n\n");
     
-    sleep_ms(10000);
+    if (!boot_stats.fast_boot) {
+        printf("Starting first counting period in %d seconds...\n\n", BOOT_FIRST_COUNT_DELAY_MS / 1000);
+        sleep_ms(BOOT_FIRST_COUNT_DELAY_MS);
+    }
     
     const float conversion_factor = 3.3f / (1 << 12);
     
+    // From here on the main loop must keep feeding the watchdog
+    watchdog_enable(WATCHDOG_TIMEOUT_MS, true);
+    
     while (1) {
         // Check for manual calibration
         if (!gpio_get(CALIBRATION_BUTTON_PIN)) {
@@ -742,18 +1462,28 @@ int main() {
             sleep_ms(1000); // Debounce
         }
         
+        // A result that never got uploaded is replaced by the new period
+        if (upload_pending) {
+            link_supervisor.uploads_dropped++;
+            upload_pending = false;
+            printf("Previous result was never uploaded - dropped\n");
+        }
+        
         // Start counting period
         start_counting_period();
         
         uint32_t period_start = to_ms_since_boot(get_absolute_time());
         uint32_t last_transmission = period_start;
+        uint32_t last_udp_tick = period_start;
         
         // Counting loop
         while (count_data.counting_active) {
             uint32_t current_time = to_ms_since_boot(get_absolute_time());
+            watchdog_update();
+            link_supervisor_poll(current_time);
             
             // Check if counting period is complete
-            if ((current_time - period_start) >= (COUNTING_PERIOD_SEC * 1000)) {
+            if (counting_period_complete(current_time - period_start)) {
                 finalize_counting_period();
                 break;
             }
@@ -768,8 +1498,21 @@ int main() {
             float voltage2 = raw2 * conversion_factor;
             
             // Detect particle events
-            detect_particle_event(1, voltage1, &sensor1_state);
-            detect_particle_event(2, voltage2, &sensor2_state);
+            bool event1 = detect_particle_event(1, voltage1, &sensor1_state);
+            bool event2 = detect_particle_event(2, voltage2, &sensor2_state);
+            
+#if UDP_TELEMETRY_ENABLED
+            if (event1) send_udp_particle_event(1, &sensor1_state);
+            if (event2) send_udp_particle_event(2, &sensor2_state);
+            
+            if ((current_time - last_udp_tick) >= UDP_TICK_INTERVAL_MS) {
+                send_udp_count_tick(current_time - period_start);
+                last_udp_tick = current_time;
+            }
+#else
+            (void)event1;
+            (void)event2;
+#endif
             
             // Send intermediate updates every 30 seconds
             if ((current_time - last_transmission) >= (TRANSMISSION_INTERVAL_SEC * 1000)) {
@@ -782,16 +1525,18 @@ int main() {
             cyw43_arch_poll();
         }
         
-        // Send final results (now encrypted)
-        if (send_particle_count_data()) {
-            printf("Encrypted particle count data transmitted successfully!\n");
-        } else {
-            printf("Failed to transmit encrypted particle count data!\n");
+        // Send final results (now encrypted), or hold them until the link is back
+        upload_pending = true;
+        upload_retry_ms = UPLOAD_RETRY_MIN_MS;
+        upload_next_attempt_ms = to_ms_since_boot(get_absolute_time());
+        if (link_supervisor.state != LINK_UP) {
+            printf("No WiFi link - upload deferred until reconnect\n");
         }
+        try_pending_upload();
         
         // Wait before next counting period
-        printf("Next counting period starts in 30 seconds...\n");
-        sleep_ms(30000);
+        printf("Next counting period starts in %d seconds...\n", IDLE_BETWEEN_PERIODS_MS / 1000);
+        idle_with_supervision(IDLE_BETWEEN_PERIODS_MS);
     }
     
     cyw43_arch_deinit();
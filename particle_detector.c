@@ -0,0 +1,105 @@
+#include "particle_detector.h"
+
+uint32_t particle_detector_update(detection_state_t *state, const detector_config_t *config,
+                                  float baseline, float voltage, uint32_t now_ms) {
+    float threshold_voltage = baseline * (1.0f - config->threshold_percent / 100.0f);
+    float hysteresis = baseline * (config->pileup_hysteresis_percent / 100.0f);
+    
+    // Update running averages
+    state->voltage_sum += voltage;
+    state->voltage_samples++;
+    
+    if (!state->in_event) {
+        if (voltage < threshold_voltage) {
+            // Event started. The particle may have arrived any time since
+            // the previous sample; that gap is blind too
+            if (state->voltage_samples > 1) {
+                state->onset_time_ms += now_ms - state->last_sample_ms;
+            }
+            state->in_event = true;
+            state->event_start_time = now_ms;
+            state->event_min_voltage = voltage;
+            state->event_baseline = baseline;
+            state->segment_min_voltage = voltage;
+            state->segment_recovering = false;
+            state->event_minima = 1;
+        }
+        state->last_sample_ms = now_ms;
+        return 0; // Don't count yet
+    }
+    
+    // Update minimum voltage during event
+    if (voltage < state->event_min_voltage) {
+        state->event_min_voltage = voltage;
+    }
+    
+    // Pile-up: a partial recovery followed by a new dip is another particle
+    if (config->pileup_hysteresis_percent > 0) {
+        if (!state->segment_recovering) {
+            if (voltage < state->segment_min_voltage) {
+                state->segment_min_voltage = voltage;
+            } else if (voltage - state->segment_min_voltage >= hysteresis) {
+                state->segment_recovering = true;
+                state->segment_max_voltage = voltage;
+            }
+        } else if (voltage > state->segment_max_voltage) {
+            state->segment_max_voltage = voltage;
+        } else if (state->segment_max_voltage - voltage >= hysteresis) {
+            state->event_minima++;
+            state->segment_recovering = false;
+            state->segment_min_voltage = voltage;
+        }
+    }
+    
+    if (voltage < threshold_voltage) {
+        return 0;
+    }
+    
+    // Event ended - analyze duration
+    uint32_t duration = now_ms - state->event_start_time;
+    float signal_drop = state->event_baseline - state->event_min_voltage;
+    
+    state->in_event = false;
+    state->last_sample_ms = now_ms;
+    state->dead_time_ms += duration;
+    state->last_event_duration_ms = duration;
+    state->last_event_drop_percent = (signal_drop / state->event_baseline) * 100.0f;
+    state->last_event_particles = 0;
+    
+    // Validate event duration; merged pulses may last one maximum per particle
+    if (duration < config->min_duration_ms ||
+        duration > config->max_duration_ms * state->event_minima) {
+        state->false_positives++;
+        return 0;
+    }
+    
+    if (state->event_minima > 1) {
+        state->pileup_events++;
+    }
+    
+    state->valid_pulses++;
+    state->valid_events += state->event_minima;
+    state->last_event_particles = state->event_minima;
+    return state->event_minima;
+}
+
+float dead_time_corrected_rate(uint32_t events, uint32_t dead_time_ms, uint32_t period_ms) {
+    if (period_ms == 0) return 0.0f;
+    
+    // Live time = period minus busy time. Fully saturated: the correction
+    // diverges, cap it at 20x (live time >= 5% of the period)
+    float live_ms = (float)period_ms - (float)dead_time_ms;
+    float min_live_ms = 0.05f * period_ms;
+    if (live_ms < min_live_ms) live_ms = min_live_ms;
+    return (float)events / live_ms;
+}
+
+float particle_detector_corrected_rate(const detection_state_t *state, uint32_t period_ms) {
+    // Pulses over live time. Busy time includes rejected events: the
+    // detector was blind then too. Dividing the split particles by live time
+    // instead would count the piled-up ones twice
+    float rate = dead_time_corrected_rate(state->valid_pulses,
+                                          state->dead_time_ms + state->onset_time_ms, period_ms);
+    float resolved = period_ms ? (float)state->valid_events / period_ms : 0.0f;
+    return rate > resolved ? rate : resolved;
+}
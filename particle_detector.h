@@ -0,0 +1,61 @@
+#ifndef PARTICLE_DETECTOR_H
+#define PARTICLE_DETECTOR_H
+
+// Particle event detector shared by the firmware (LASER_INIT.c) and the
+// host simulator (tools/pileup_sim.c). No Pico SDK dependencies.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Detection parameters (filled from the #defines in LASER_INIT.c)
+typedef struct {
+    float threshold_percent;           // Signal drop that starts an event
+    uint32_t min_duration_ms;          // Shorter events are noise
+    uint32_t max_duration_ms;          // Longer single-dip events are bubbles
+    float pileup_hysteresis_percent;   // Recovery needed between two dips (0 = no splitting)
+} detector_config_t;
+
+// Event detection state for each sensor
+typedef struct {
+    bool in_event;
+    uint32_t event_start_time;
+    float event_min_voltage;
+    float event_baseline;
+    uint32_t valid_events;
+    uint32_t false_positives;
+    float voltage_sum;                 // For calculating average
+    uint32_t voltage_samples;
+    uint32_t last_event_duration_ms;   // Details of last finished event
+    float last_event_drop_percent;
+    uint32_t last_event_particles;     // 0 if the event was rejected
+    
+    // Pile-up tracking: local minima inside the current event
+    float segment_min_voltage;
+    float segment_max_voltage;
+    bool segment_recovering;
+    uint32_t event_minima;
+    
+    uint32_t valid_pulses;             // Valid events before pile-up splitting
+    uint32_t pileup_events;            // Merged events split into several particles
+    uint32_t dead_time_ms;             // Time spent inside events (detector busy)
+    uint32_t onset_time_ms;            // Sample gaps before event starts (arrival not yet visible)
+    uint32_t last_sample_ms;
+} detection_state_t;
+
+// Feed one sample; returns the number of particles counted by this sample
+// (non-zero only when an event ends and passes validation)
+uint32_t particle_detector_update(detection_state_t *state, const detector_config_t *config,
+                                  float baseline, float voltage, uint32_t now_ms);
+
+// Non-paralyzable dead-time correction: n = m / (1 - m * tau), with the
+// total dead time m * tau * T taken from the measured busy time, i.e.
+// events / (period - dead time)
+float dead_time_corrected_rate(uint32_t events, uint32_t dead_time_ms, uint32_t period_ms);
+
+// Particle rate (per ms) for a counting period. Every particle arriving
+// while the detector is live starts a pulse, so pulses over live time
+// estimate the true rate; particles that piled up are part of that estimate
+// already. Never less than the resolved particles (pile-ups split) per period.
+float particle_detector_corrected_rate(const detection_state_t *state, uint32_t period_ms);
+
+#endif
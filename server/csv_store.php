@@ -0,0 +1,320 @@
+<?php
+// Append-only CSV store helpers shared by the server scripts
+//
+// Reads never load a whole CSV file:
+// - csv_tail_lines() seeks backwards from the end in blocks
+// - a sidecar index (<file>.idx) maps row timestamps to byte offsets and
+//   is extended incrementally, so range queries binary-search it
+//
+// Index layout: 8 byte header holding the number of CSV bytes covered,
+// then one 12 byte record per data row: uint32 unix time + uint64 offset.
+
+require_once __DIR__ . '/log.php';
+
+$CSV_INDEX_HEADER_SIZE = 8;
+$CSV_INDEX_RECORD_SIZE = 12;
+$CSV_TAIL_BLOCK_SIZE = 8192;
+
+// Time query parameter: unix timestamp or anything strtotime() understands
+function parse_time_param($value) {
+    return is_numeric($value) ? intval($value) : strtotime($value);
+}
+
+function csv_index_path($csv_file) {
+    return $csv_file . '.idx';
+}
+
+// Header columns of a CSV file (first line only)
+function csv_read_header($csv_file) {
+    $fp = @fopen($csv_file, 'r');
+    if (!$fp) return [];
+    $line = fgets($fp);
+    fclose($fp);
+    return $line === false ? [] : str_getcsv(rtrim($line, "\r\n"));
+}
+
+// Last $count data lines (oldest first), read backwards in blocks
+function csv_tail_lines($csv_file, $count) {
+    global $CSV_TAIL_BLOCK_SIZE;
+    
+    $fp = @fopen($csv_file, 'r');
+    if (!$fp || $count <= 0) return [];
+    
+    fseek($fp, 0, SEEK_END);
+    $pos = ftell($fp);
+    $buffer = '';
+    
+    // Need $count complete lines plus the newline that precedes them
+    while ($pos > 0 && substr_count($buffer, "\n") <= $count) {
+        $read = min($CSV_TAIL_BLOCK_SIZE, $pos);
+        $pos -= $read;
+        fseek($fp, $pos);
+        $buffer = fread($fp, $read) . $buffer;
+    }
+    fclose($fp);
+    
+    // Drop a last row that is still being written
+    if (substr($buffer, -1) !== "\n") {
+        $end = strrpos($buffer, "\n");
+        $buffer = $end === false ? '' : substr($buffer, 0, $end + 1);
+    }
+    
+    // First element is either the header or a partial line
+    $lines = explode("\n", rtrim($buffer, "\r\n"));
+    array_shift($lines);
+    
+    $lines = array_values(array_filter($lines, function ($line) {
+        return trim($line) !== '';
+    }));
+    return array_slice($lines, -$count);
+}
+
+// Extend the sidecar index with rows appended since the last sync.
+// Only the unindexed tail of the CSV is scanned.
+function csv_index_sync($csv_file, $timestamp_column = 'server_timestamp') {
+    global $CSV_INDEX_HEADER_SIZE;
+    
+    if (!file_exists($csv_file)) return false;
+    
+    $idx = fopen(csv_index_path($csv_file), 'c+');
+    if (!$idx) return false;
+    flock($idx, LOCK_EX);
+    
+    $header = fread($idx, $CSV_INDEX_HEADER_SIZE);
+    $covered = strlen($header) === $CSV_INDEX_HEADER_SIZE ? unpack('J', $header)[1] : 0;
+    
+    clearstatcache(true, $csv_file);
+    $size = filesize($csv_file);
+    
+    // CSV was truncated or rotated: start over
+    if ($covered > $size) {
+        ftruncate($idx, 0);
+        $covered = 0;
+    }
+    
+    if ($covered < $size) {
+        $csv = fopen($csv_file, 'r');
+        $columns = str_getcsv(rtrim(fgets($csv), "\r\n"));
+        $ts_index = array_search($timestamp_column, $columns);
+        if ($ts_index === false) $ts_index = 0;
+        
+        if ($covered === 0) {
+            $covered = ftell($csv); // Skip the header row
+            ftruncate($idx, 0);
+        }
+        fseek($csv, $covered);
+        
+        $records = '';
+        while (($line = fgets($csv)) !== false) {
+            if (substr($line, -1) !== "\n") break; // Row still being written
+            
+            $values = str_getcsv(rtrim($line, "\r\n"));
+            $ts_value = $values[$ts_index] ?? '';
+            $unix_time = is_numeric($ts_value) ? intval($ts_value) : strtotime($ts_value);
+            if (trim($line) !== '' && $unix_time !== false) {
+                $records .= pack('NJ', $unix_time, $covered);
+            }
+            $covered += strlen($line);
+        }
+        fclose($csv);
+        
+        fseek($idx, 0, SEEK_END);
+        if (ftell($idx) < $CSV_INDEX_HEADER_SIZE) {
+            fseek($idx, $CSV_INDEX_HEADER_SIZE);
+        }
+        fwrite($idx, $records);
+        fseek($idx, 0);
+        fwrite($idx, pack('J', $covered));
+        fflush($idx);
+    }
+    
+    flock($idx, LOCK_UN);
+    fclose($idx);
+    return true;
+}
+
+// Rewrite a CSV whose header predates new columns (called under lock).
+// Old rows are remapped by column name and padded with empty values, so
+// readers that map rows by header keep seeing every row. Returns false,
+// leaving the file untouched, if an old column would be lost.
+function csv_upgrade_header($fp, $csv_file, $header) {
+    rewind($fp);
+    $old_header = rtrim(fgets($fp) ?: '', "\r\n");
+    if ($old_header === rtrim($header, "\r\n")) return true;
+    
+    $old_columns = str_getcsv($old_header);
+    $new_columns = str_getcsv(rtrim($header, "\r\n"));
+    if (array_diff($old_columns, $new_columns)) return false;
+    
+    $positions = array_flip($old_columns);
+    $content = $header;
+    while (($line = fgets($fp)) !== false) {
+        if (trim($line) === '') continue;
+        $values = str_getcsv(rtrim($line, "\r\n"));
+        $row = [];
+        foreach ($new_columns as $column) {
+            $value = isset($positions[$column]) ? ($values[$positions[$column]] ?? '') : '';
+            $row[] = ($value === '' || is_numeric($value)) ? $value : '"' . str_replace('"', '""', $value) . '"';
+        }
+        $content .= implode(',', $row) . "\n";
+    }
+    
+    ftruncate($fp, 0);
+    rewind($fp);
+    fwrite($fp, $content);
+    
+    // Offsets changed: rebuild the index from scratch
+    @unlink(csv_index_path($csv_file));
+    return true;
+}
+
+// Append one row under lock. $header is written in the same append when
+// the file is new or empty, and an existing file with an older header is
+// upgraded first. Returns false without writing if the header cannot be
+// upgraded: a row under the wrong header would be misread by every reader.
+function csv_append($csv_file, $csv_line, $header = null) {
+    $fp = fopen($csv_file, 'c+');
+    if (!$fp) return false;
+    flock($fp, LOCK_EX);
+    
+    if ($header !== null) {
+        if (fstat($fp)['size'] === 0) {
+            $csv_line = $header . $csv_line;
+        } elseif (!csv_upgrade_header($fp, $csv_file, $header)) {
+            flock($fp, LOCK_UN);
+            fclose($fp);
+            debug_log('error', "CSV: $csv_file has columns missing from the current header; row not written");
+            return false;
+        }
+    }
+    fseek($fp, 0, SEEK_END);
+    fwrite($fp, $csv_line);
+    fflush($fp);
+    
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return true;
+}
+
+// Append one row (see csv_append()) and index it
+function csv_append_indexed($csv_file, $csv_line, $header = null, $timestamp_column = 'server_timestamp') {
+    if (!csv_append($csv_file, $csv_line, $header)) return false;
+    return csv_index_sync($csv_file, $timestamp_column);
+}
+
+// Number of indexed data rows
+function csv_index_count($csv_file, $timestamp_column = 'server_timestamp') {
+    global $CSV_INDEX_HEADER_SIZE, $CSV_INDEX_RECORD_SIZE;
+    
+    if (!csv_index_sync($csv_file, $timestamp_column)) return 0;
+    clearstatcache(true, csv_index_path($csv_file));
+    return max(0, intdiv(filesize(csv_index_path($csv_file)) - $CSV_INDEX_HEADER_SIZE, $CSV_INDEX_RECORD_SIZE));
+}
+
+// Index record $i as [unix_time, offset]
+function csv_index_record($idx, $i) {
+    global $CSV_INDEX_HEADER_SIZE, $CSV_INDEX_RECORD_SIZE;
+    
+    fseek($idx, $CSV_INDEX_HEADER_SIZE + $i * $CSV_INDEX_RECORD_SIZE);
+    $record = unpack('Ntime/Joffset', fread($idx, $CSV_INDEX_RECORD_SIZE));
+    return [$record['time'], $record['offset']];
+}
+
+// First record with time >= $unix_time (binary search)
+function csv_index_lower_bound($idx, $count, $unix_time) {
+    $low = 0;
+    $high = $count;
+    while ($low < $high) {
+        $mid = intdiv($low + $high, 2);
+        if (csv_index_record($idx, $mid)[0] < $unix_time) {
+            $low = $mid + 1;
+        } else {
+            $high = $mid;
+        }
+    }
+    return $low;
+}
+
+// Data lines with $from <= time <= $to (oldest first), at most $limit rows
+function csv_range_lines($csv_file, $from, $to, $limit, $timestamp_column = 'server_timestamp') {
+    $count = csv_index_count($csv_file, $timestamp_column);
+    if ($count === 0) return [];
+    
+    $idx = fopen(csv_index_path($csv_file), 'r');
+    flock($idx, LOCK_SH);
+    $first = csv_index_lower_bound($idx, $count, $from);
+    $end = csv_index_lower_bound($idx, $count, $to + 1);
+    $end = min($end, $first + $limit);
+    $offsets = [];
+    for ($i = $first; $i < $end; $i++) {
+        $offsets[] = csv_index_record($idx, $i)[1];
+    }
+    flock($idx, LOCK_UN);
+    fclose($idx);
+    
+    $lines = [];
+    if (!$offsets) return $lines;
+    
+    // Read sequentially but keep only rows the index points at: rows it
+    // skipped (blank, unparsable timestamp) are not part of the range
+    $csv = fopen($csv_file, 'r');
+    $pos = $offsets[0];
+    fseek($csv, $pos);
+    $next = 0;
+    while ($next < count($offsets) && ($line = fgets($csv)) !== false) {
+        if ($pos > $offsets[$next]) break; // File rewritten since the index was read
+        if ($pos === $offsets[$next]) {
+            $lines[] = rtrim($line, "\r\n");
+            $next++;
+        }
+        $pos += strlen($line);
+    }
+    fclose($csv);
+    
+    return $lines;
+}
+
+// Complete data lines after byte offset $cursor, at most $limit rows.
+// A cursor of 0, past the end of the file or not on a line boundary
+// restarts from the first data row and sets 'reset'.
+function csv_read_from($csv_file, $cursor, $limit) {
+    $result = ['lines' => [], 'cursor' => 0, 'reset' => false, 'more' => false];
+    
+    $fp = @fopen($csv_file, 'r');
+    if (!$fp) {
+        $result['reset'] = $cursor > 0;
+        return $result;
+    }
+    
+    $header_end = strlen(fgets($fp) ?: '');
+    clearstatcache(true, $csv_file);
+    $size = filesize($csv_file);
+    
+    $valid = $cursor >= $header_end && $cursor <= $size;
+    if ($valid && $cursor > $header_end) {
+        fseek($fp, $cursor - 1);
+        $valid = fread($fp, 1) === "\n";
+    }
+    if (!$valid) {
+        $result['reset'] = $cursor > 0;
+        $cursor = $header_end;
+    }
+    
+    fseek($fp, $cursor);
+    while (($line = fgets($fp)) !== false) {
+        if (substr($line, -1) !== "\n") break; // Row still being written
+        if (count($result['lines']) >= $limit) {
+            $result['more'] = true;
+            break;
+        }
+        $cursor += strlen($line);
+        if (trim($line) !== '') {
+            $result['lines'][] = rtrim($line, "\r\n");
+        }
+    }
+    fclose($fp);
+    
+    $result['cursor'] = $cursor;
+    return $result;
+}
+?>
@@ -0,0 +1,158 @@
+<?php
+// Device table for a fleet of particle counters
+//
+// devices.json maps each device ID (16 hex chars, printed by the firmware
+// at startup) to its settings:
+//   { "3bc1a5a19108b57c": { "name": "Lab bench", "key": "<32 hex chars>" }, ... }
+// "key" is the device's secret XTEA key (XTEA_DEVICE_KEY in the firmware).
+// Without it the key is derived from the device ID, which travels in
+// cleartext (X-Device-ID header, UDP header), so anyone who sees the
+// traffic can decrypt and forge it.
+// The first entry is the default device for requests without an
+// X-Device-ID header (older firmware).
+//
+// The table is parsed once per process and derived XTEA keys are cached
+// per device; with APCu both survive across requests. Every device gets
+// its own storage directory (data/<device_id>/) so ingestion and queries
+// for different devices never contend for the same files.
+
+require_once __DIR__ . '/xtea.php';
+
+$DEVICES_FILE = __DIR__ . '/devices.json';
+$DEVICES_DATA_DIR = __DIR__ . '/data';
+$DEVICES_FALLBACK_ID = "3bc1a5a19108b57c"; // Used only when devices.json is missing
+
+function device_id_valid($device_id) {
+    return is_string($device_id) && preg_match('/^[0-9a-f]{16}$/', $device_id) === 1;
+}
+
+// 32 hex chars -> 4 key words (big-endian, as in the firmware), or null
+function device_secret_key($hex) {
+    if (!is_string($hex) || preg_match('/^[0-9a-fA-F]{32}$/', $hex) !== 1) {
+        return null;
+    }
+    return array_values(unpack('N4', hex2bin($hex)));
+}
+
+// Device table, loaded once per process (and per devices.json change)
+function device_table() {
+    global $DEVICES_FILE, $DEVICES_FALLBACK_ID;
+    static $table = null;
+    
+    if ($table !== null) return $table;
+    
+    $mtime = @filemtime($DEVICES_FILE);
+    $cache_key = 'pc_devices_' . $mtime;
+    if ($mtime && function_exists('apcu_fetch')) {
+        $cached = apcu_fetch($cache_key, $found);
+        if ($found) return $table = $cached;
+    }
+    
+    $table = [];
+    $json = $mtime ? json_decode(file_get_contents($DEVICES_FILE), true) : null;
+    if (is_array($json)) {
+        foreach ($json as $device_id => $settings) {
+            $device_id = strtolower($device_id);
+            if (!device_id_valid($device_id)) continue;
+            $key = device_secret_key($settings['key'] ?? '');
+            $table[$device_id] = [
+                'name' => $settings['name'] ?? $device_id,
+                'key' => $key ?? generate_xtea_key($device_id),
+                'secret_key' => $key !== null
+            ];
+        }
+    }
+    if (empty($table)) {
+        $table[$DEVICES_FALLBACK_ID] = [
+            'name' => 'Default device',
+            'key' => generate_xtea_key($DEVICES_FALLBACK_ID),
+            'secret_key' => false
+        ];
+    }
+    
+    if ($mtime && function_exists('apcu_store')) {
+        apcu_store($cache_key, $table);
+    }
+    return $table;
+}
+
+function device_known($device_id) {
+    return isset(device_table()[$device_id]);
+}
+
+function device_default_id() {
+    return array_key_first(device_table());
+}
+
+// Cached XTEA key for a known device
+function device_xtea_key($device_id) {
+    $table = device_table();
+    if (!isset($table[$device_id])) {
+        throw new Exception("Unknown device $device_id");
+    }
+    return $table[$device_id]['key'];
+}
+
+// Device ID from the request (?device= or X-Device-ID), default if absent
+function device_from_request() {
+    $device_id = strtolower($_GET['device'] ?? ($_SERVER['HTTP_X_DEVICE_ID'] ?? ''));
+    return $device_id === '' ? device_default_id() : $device_id;
+}
+
+// Device of a read request, or a JSON 404 and exit if it is not in the table
+function require_known_device() {
+    $device_id = device_from_request();
+    if (!device_known($device_id)) {
+        header('Content-Type: application/json');
+        http_response_code(404);
+        echo json_encode(['status' => 'error', 'message' => 'Unknown device']);
+        exit();
+    }
+    return $device_id;
+}
+
+// Path of a per-device storage file, creating the directory on demand
+function device_path($device_id, $file) {
+    global $DEVICES_DATA_DIR;
+    
+    if (!device_id_valid($device_id)) {
+        throw new Exception("Invalid device ID");
+    }
+    $dir = $DEVICES_DATA_DIR . '/' . $device_id;
+    if (!is_dir($dir)) {
+        @mkdir($dir, 0775, true);
+    }
+    if ($device_id === device_default_id()) {
+        device_migrate_legacy($dir, $file);
+    }
+    return $dir . '/' . $file;
+}
+
+// Data written by the single-device server (top-level files next to the
+// scripts) belongs to the default device: move it into data/<device_id>/
+// the first time the file is used, together with its sidecars (index,
+// rollup tiers, rotated logs). A file that already exists in the device
+// directory is never overwritten.
+function device_migrate_legacy($dir, $file) {
+    static $checked = [];
+    if (isset($checked[$file])) return;
+    $checked[$file] = true;
+    
+    $legacy = array_merge([__DIR__ . '/' . $file], glob(__DIR__ . '/' . $file . '.*') ?: []);
+    foreach ($legacy as $path) {
+        $target = $dir . '/' . basename($path);
+        if (is_file($path) && !file_exists($target)) {
+            @rename($path, $target); // Concurrent request may have moved it already
+        }
+    }
+}
+
+// [{id, name}] for the dashboard device selector
+function device_list() {
+    $list = [];
+    foreach (device_table() as $device_id => $device) {
+        $list[] = ['id' => $device_id, 'name' => $device['name'], 'secret_key' => $device['secret_key']];
+    }
+    return $list;
+}
+?>
@@ -2,31 +2,47 @@
 header('Content-Type: application/json');
 header('Access-Control-Allow-Origin: *');
 
-$csv_file = 'sensor_data.csv';
+require_once __DIR__ . '/csv_store.php';
+require_once __DIR__ . '/devices.php';
+
+$device_id = require_known_device(); // ?device=<id>, default device if absent
+
+$csv_file = device_path($device_id, 'sensor_data.csv');
+$max_rows = 5000; // Upper bound for time-range queries
 
 if (!file_exists($csv_file)) {
     echo json_encode(['status' => 'error', 'message' => 'No data file found', 'readings' => []]);
     exit();
 }
 
-$lines = file($csv_file, FILE_IGNORE_NEW_LINES | FILE_SKIP_EMPTY_LINES);
-if (count($lines) < 2) {
+$header = csv_read_header($csv_file);
+if (empty($header)) {
     echo json_encode(['status' => 'success', 'count' => 0, 'readings' => []]);
     exit();
 }
 
-$header = str_getcsv($lines[0]);
-$readings = [];
+if (isset($_GET['from']) || isset($_GET['to'])) {
+    // Time-range query served from the sidecar offset index
+    $from = isset($_GET['from']) ? parse_time_param($_GET['from']) : 0;
+    $to = isset($_GET['to']) ? parse_time_param($_GET['to']) : time();
+    if ($from === false || $to === false) {
+        echo json_encode(['status' => 'error', 'message' => 'Invalid from/to time', 'readings' => []]);
+        exit();
+    }
+    $data_lines = csv_range_lines($csv_file, $from, $to, $max_rows);
+} else {
+    // Last N readings, read backwards from the end of the file
+    $limit = max(1, min($max_rows, intval($_GET['limit'] ?? 50)));
+    $data_lines = csv_tail_lines($csv_file, $limit);
+}
 
-// Get last 50 readings (skip header)
-$data_lines = array_slice($lines, 1);
 $data_lines = array_reverse($data_lines); // Most recent first
-$data_lines = array_slice($data_lines, 0, 50); // Last 50
+$readings = [];
 
 foreach ($data_lines as $line) {
     $values = str_getcsv($line);
     if (count($values) >= count($header)) {
-        $reading = array_combine($header, $values);
+        $reading = array_combine($header, array_slice($values, 0, count($header)));
         $readings[] = $reading;
     }
 }
@@ -37,4 +53,4 @@ echo json_encode([
     'last_updated' => date('Y-m-d H:i:s'),
     'readings' => $readings
 ], JSON_PRETTY_PRINT);
-?>
\ No newline at end of file
+?>
@@ -0,0 +1,99 @@
+<?php
+// Incremental feed of new particle count rows for the dashboard
+//
+// GET get_delta.php?device=<id>&cursor=<offset>         -> JSON with rows after cursor
+// GET get_delta.php?device=<id>&cursor=<offset>&stream  -> Server-Sent Events
+//
+// The cursor is the byte offset returned by the previous call. Start with
+// cursor=0; when 'reset' is true the client must drop its local rows
+// (the CSV was replaced) and use the rows returned instead.
+//
+// &stream keeps the request open for $stream_seconds, so it needs a server
+// with several workers (php-fpm, Apache prefork). Under the single-threaded
+// built-in server (php -S) an open stream would block device uploads, so
+// streaming is refused there and clients should poll instead.
+
+header('Access-Control-Allow-Origin: *');
+
+require_once __DIR__ . '/csv_store.php';
+require_once __DIR__ . '/devices.php';
+
+$device_id = require_known_device(); // ?device=<id>, default device if absent
+
+$csv_file = device_path($device_id, 'particle_counts.csv');
+$max_rows = 1000;       // Rows per response; client repeats while 'more'
+$stream_seconds = 55;   // SSE connection lifetime before the browser reconnects
+$stream_poll_ms = 1000;
+
+// EventSource resends the last event id as a header on reconnect
+$cursor = intval($_SERVER['HTTP_LAST_EVENT_ID'] ?? ($_GET['cursor'] ?? 0));
+
+function build_delta($csv_file, $cursor, $max_rows) {
+    $delta = csv_read_from($csv_file, $cursor, $max_rows);
+    
+    $rows = [];
+    foreach ($delta['lines'] as $line) {
+        $rows[] = str_getcsv($line);
+    }
+    
+    $response = [
+        'cursor' => $delta['cursor'],
+        'reset' => $delta['reset'],
+        'more' => $delta['more'],
+        'rows' => $rows
+    ];
+    
+    // Column names only when the client starts over
+    if ($cursor === 0 || $delta['reset']) {
+        $response['columns'] = csv_read_header($csv_file);
+    }
+    
+    return $response;
+}
+
+if (isset($_GET['stream']) && PHP_SAPI === 'cli-server') {
+    header('Content-Type: application/json');
+    http_response_code(501);
+    echo json_encode(['status' => 'error', 'message' => 'Streaming needs a multi-worker server; poll without &stream']);
+    exit();
+}
+
+if (!isset($_GET['stream'])) {
+    header('Content-Type: application/json');
+    header('Cache-Control: no-store');
+    echo json_encode(build_delta($csv_file, $cursor, $max_rows));
+    exit();
+}
+
+// Server-Sent Events: push a delta whenever the CSV grows
+header('Content-Type: text/event-stream');
+header('Cache-Control: no-cache');
+header('X-Accel-Buffering: no');
+set_time_limit($stream_seconds + 10);
+ignore_user_abort(false);
+
+echo "retry: 2000\n\n";
+flush();
+
+$deadline = time() + $stream_seconds;
+$first = true;
+while (time() < $deadline && !connection_aborted()) {
+    clearstatcache(true, $csv_file);
+    $size = file_exists($csv_file) ? filesize($csv_file) : 0;
+    
+    if ($first || $size !== $cursor) {
+        $delta = build_delta($csv_file, $cursor, $max_rows);
+        $first = false;
+        
+        if (!empty($delta['rows']) || $delta['reset'] || isset($delta['columns'])) {
+            echo "id: " . $delta['cursor'] . "\n";
+            echo "data: " . json_encode($delta) . "\n\n";
+            flush();
+        }
+        $cursor = $delta['cursor'];
+        if ($delta['more']) continue;
+    }
+    
+    usleep($stream_poll_ms * 1000);
+}
+?>
@@ -0,0 +1,72 @@
+<?php
+// Long-range history from the rollup tiers
+//
+// GET get_rollup.php?device=<id>&from=<time>&to=<time>&points=200
+// GET get_rollup.php?device=<id>&from=<time>&to=<time>&resolution=3600
+//
+// Picks the coarsest tier (minute/hour/day) whose bucket width does not
+// exceed the requested resolution, then merges buckets so at most about
+// `points` values are returned. The cost depends on the number of points,
+// not on the number of raw counting periods in the range.
+
+header('Content-Type: application/json');
+header('Access-Control-Allow-Origin: *');
+
+require_once __DIR__ . '/csv_store.php';
+require_once __DIR__ . '/rollup.php';
+require_once __DIR__ . '/devices.php';
+
+$device_id = require_known_device(); // ?device=<id>, default device if absent
+
+$rollup_prefix = device_path($device_id, 'particle_counts');
+$default_points = 200;
+$max_points = 2000;
+
+$to = isset($_GET['to']) ? parse_time_param($_GET['to']) : time();
+$from = isset($_GET['from']) ? parse_time_param($_GET['from']) : $to - 86400;
+if ($from === false || $to === false || $from > $to) {
+    echo json_encode(['status' => 'error', 'message' => 'Invalid from/to time']);
+    exit();
+}
+
+$points = max(1, min($max_points, intval($_GET['points'] ?? $default_points)));
+$resolution = max(1, intval($_GET['resolution'] ?? 0), intval(ceil(($to - $from + 1) / $points)));
+
+$tier = rollup_pick_tier($resolution);
+$step = $ROLLUP_TIERS[$tier];
+$resolution = intval(ceil($resolution / $step)) * $step; // Whole buckets only
+
+$merged = rollup_merge(rollup_read_range($rollup_prefix, $tier, $from - ($from % $step), $to), $resolution);
+
+$rows = [];
+foreach ($merged as $p) {
+    $minutes = $p['duration_ms'] / 60000;
+    $rows[] = [
+        $p['start'],
+        $p['periods'],
+        $p['duration_ms'],
+        $p['s1_min'],
+        $p['s1_max'],
+        round($p['s1_sum'] / $p['periods'], 2),
+        $p['s1_sum'],
+        $p['s2_min'],
+        $p['s2_max'],
+        round($p['s2_sum'] / $p['periods'], 2),
+        $p['s2_sum'],
+        $minutes > 0 ? round(($p['s1_sum'] + $p['s2_sum']) / 2 / $minutes, 2) : 0
+    ];
+}
+
+echo json_encode([
+    'status' => 'success',
+    'tier' => $tier,
+    'resolution' => $resolution,
+    'from' => $from,
+    'to' => $to,
+    'columns' => ['start', 'periods', 'duration_ms',
+                  'sensor1_min', 'sensor1_max', 'sensor1_mean', 'sensor1_sum',
+                  'sensor2_min', 'sensor2_max', 'sensor2_mean', 'sensor2_sum',
+                  'avg_concentration_per_min'],
+    'points' => $rows
+]);
+?>
@@ -0,0 +1,70 @@
+<?php
+// Buffered, level-gated logging for the request handlers
+//
+// Messages are collected in memory and written with one locked append
+// per log file when the request finishes. Log files are rotated by size
+// (debug.log -> debug.log.1 -> ...), keeping $LOG_KEEP_FILES old copies.
+//
+// Levels: 'error' (default) only records failures, 'info' adds one line
+// per request, 'debug' adds decryption details and payload dumps.
+// Override with the PC_LOG_LEVEL environment variable.
+
+$LOG_LEVELS = ['error' => 0, 'info' => 1, 'debug' => 2];
+$LOG_LEVEL = getenv('PC_LOG_LEVEL') ?: 'error';
+$LOG_MAX_BYTES = 1024 * 1024;
+$LOG_KEEP_FILES = 3;
+
+$LOG_BUFFERS = []; // file => pending text
+
+function log_enabled($level) {
+    global $LOG_LEVELS, $LOG_LEVEL;
+    return ($LOG_LEVELS[$level] ?? 2) <= ($LOG_LEVELS[$LOG_LEVEL] ?? 0);
+}
+
+// Queue a line for debug.log if $level is enabled
+function debug_log($level, $message) {
+    global $timestamp;
+    
+    if (!log_enabled($level)) return;
+    // Long-running scripts (udp_receiver.php) have no per-request timestamp
+    $stamp = $timestamp ?? date('Y-m-d H:i:s');
+    log_write('debug.log', "[$stamp] $message\n");
+}
+
+// Queue text for any log file (written by log_flush)
+function log_write($log_file, $text) {
+    global $LOG_BUFFERS;
+    
+    $LOG_BUFFERS[$log_file] = ($LOG_BUFFERS[$log_file] ?? '') . $text;
+}
+
+// Shift $log_file to $log_file.1 etc. once it exceeds $LOG_MAX_BYTES
+function log_rotate($log_file) {
+    global $LOG_MAX_BYTES, $LOG_KEEP_FILES;
+    
+    clearstatcache(true, $log_file);
+    if (!file_exists($log_file) || filesize($log_file) < $LOG_MAX_BYTES) return;
+    
+    for ($i = $LOG_KEEP_FILES - 1; $i >= 1; $i--) {
+        if (file_exists("$log_file.$i")) {
+            @rename("$log_file.$i", "$log_file." . ($i + 1));
+        }
+    }
+    @rename($log_file, "$log_file.1");
+}
+
+// Write all queued log text, one locked append per file
+function log_flush() {
+    global $LOG_BUFFERS;
+    
+    foreach ($LOG_BUFFERS as $log_file => $text) {
+        log_rotate($log_file);
+        file_put_contents($log_file, $text, FILE_APPEND | LOCK_EX);
+    }
+    $LOG_BUFFERS = [];
+}
+
+// Early exit() paths still get their log lines written. Long-running
+// scripts must call log_flush() themselves.
+register_shutdown_function('log_flush');
+?>
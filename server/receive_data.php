@@ -2,113 +2,17 @@
 header('Content-Type: application/json');
 header('Access-Control-Allow-Origin: *');
 header('Access-Control-Allow-Methods: POST, GET, OPTIONS');
-header('Access-Control-Allow-Headers: Content-Type, X-Encryption');
+header('Access-Control-Allow-Headers: Content-Type, X-Encryption, X-Device-ID');
 
+$request_start = microtime(true);
 $timestamp = date('Y-m-d H:i:s');
-$debug_log = "debug.log";
 
-// XTEA Encryption Configuration
-// IMPORTANT: Update this with your Pico's device ID (8 hex bytes)
-// Get this from your Pico's console output during initialization
-$DEVICE_ID = "3bc1a5a19108b57c"; // Replace with actual device ID from Pico
-$XTEA_KEY_SIZE = 16; // 4 x 32-bit words
-$XTEA_BLOCK_SIZE = 8; // 8 bytes per block
-$XTEA_ROUNDS = 32;
-
-// Generate XTEA key from device ID (matching Pico's method)
-function generate_xtea_key($device_id_hex) {
-    global $XTEA_KEY_SIZE;
-    
-    // Convert hex string to bytes
-    $device_bytes = hex2bin($device_id_hex);
-    if (strlen($device_bytes) !== 8) {
-        throw new Exception("Device ID must be exactly 8 bytes (16 hex chars)");
-    }
-    
-    // Generate 4 x 32-bit key words (matching Pico's logic)
-    $key = array();
-    $key[0] = (ord($device_bytes[0]) << 24) | (ord($device_bytes[1]) << 16) | 
-              (ord($device_bytes[2]) << 8) | ord($device_bytes[3]);
-    $key[1] = (ord($device_bytes[4]) << 24) | (ord($device_bytes[5]) << 16) | 
-              (ord($device_bytes[6]) << 8) | ord($device_bytes[7]);
-    $key[2] = $key[0] ^ 0xAAAAAAAA; // Add variety (matching Pico)
-    $key[3] = $key[1] ^ 0x55555555; // Add variety (matching Pico)
-    
-    return $key;
-}
-
-// XTEA decryption function
-function xtea_decrypt_block($data, $key) {
-    global $XTEA_ROUNDS;
-    
-    $v0 = $data[0];
-    $v1 = $data[1];
-    $sum = 0xC6EF3720; // delta * rounds
-    $delta = 0x9E3779B9;
-    
-    for ($i = 0; $i < $XTEA_ROUNDS; $i++) {
-        $v1 = ($v1 - ((($v0 << 4) ^ ($v0 >> 5)) + $v0) ^ ($sum + $key[($sum >> 11) & 3])) & 0xFFFFFFFF;
-        $sum = ($sum - $delta) & 0xFFFFFFFF;
-        $v0 = ($v0 - ((($v1 << 4) ^ ($v1 >> 5)) + $v1) ^ ($sum + $key[$sum & 3])) & 0xFFFFFFFF;
-    }
-    
-    return array($v0, $v1);
-}
-
-// Decrypt XTEA-encrypted data
-function decrypt_xtea_data($encrypted_data, $key) {
-    global $XTEA_BLOCK_SIZE;
-    
-    if (strlen($encrypted_data) % $XTEA_BLOCK_SIZE !== 0) {
-        throw new Exception("Encrypted data length must be multiple of " . $XTEA_BLOCK_SIZE);
-    }
-    
-    $decrypted = '';
-    
-    // Decrypt each 8-byte block
-    for ($i = 0; $i < strlen($encrypted_data); $i += $XTEA_BLOCK_SIZE) {
-        $block_bytes = substr($encrypted_data, $i, $XTEA_BLOCK_SIZE);
-        
-        // Convert bytes to 32-bit words (little endian)
-        $data = array();
-        $data[0] = (ord($block_bytes[3]) << 24) | (ord($block_bytes[2]) << 16) | 
-                   (ord($block_bytes[1]) << 8) | ord($block_bytes[0]);
-        $data[1] = (ord($block_bytes[7]) << 24) | (ord($block_bytes[6]) << 16) | 
-                   (ord($block_bytes[5]) << 8) | ord($block_bytes[4]);
-        
-        // Decrypt block
-        $decrypted_block = xtea_decrypt_block($data, $key);
-        
-        // Convert back to bytes (little endian)
-        $decrypted .= chr($decrypted_block[0] & 0xFF);
-        $decrypted .= chr(($decrypted_block[0] >> 8) & 0xFF);
-        $decrypted .= chr(($decrypted_block[0] >> 16) & 0xFF);
-        $decrypted .= chr(($decrypted_block[0] >> 24) & 0xFF);
-        $decrypted .= chr($decrypted_block[1] & 0xFF);
-        $decrypted .= chr(($decrypted_block[1] >> 8) & 0xFF);
-        $decrypted .= chr(($decrypted_block[1] >> 16) & 0xFF);
-        $decrypted .= chr(($decrypted_block[1] >> 24) & 0xFF);
-    }
-    
-    // Remove padding
-    $padding = ord($decrypted[strlen($decrypted) - 1]);
-    if ($padding > 0 && $padding <= $XTEA_BLOCK_SIZE) {
-        // Verify padding
-        $valid_padding = true;
-        for ($i = strlen($decrypted) - $padding; $i < strlen($decrypted); $i++) {
-            if (ord($decrypted[$i]) !== $padding) {
-                $valid_padding = false;
-                break;
-            }
-        }
-        
-        if ($valid_padding) {
-            $decrypted = substr($decrypted, 0, strlen($decrypted) - $padding);
-        }
-    }
-    
-    return $decrypted;
-}
+// Device table and cached XTEA keys (devices.json, see devices.php).
+// Each Pico sends its ID in the X-Device-ID header.
+require_once __DIR__ . '/devices.php';
+require_once __DIR__ . '/csv_store.php';
+require_once __DIR__ . '/rollup.php';
+require_once __DIR__ . '/log.php';
 
 // Check if request is encrypted
 function is_encrypted_request() {
@@ -121,7 +25,7 @@ function is_encrypted_request() {
 }
 
 // Log incoming request
-file_put_contents($debug_log, "[$timestamp] " . $_SERVER['REQUEST_METHOD'] . " from " . ($_SERVER['REMOTE_ADDR'] ?? 'unknown') . "\n", FILE_APPEND);
+debug_log('debug', $_SERVER['REQUEST_METHOD'] . " from " . ($_SERVER['REMOTE_ADDR'] ?? 'unknown'));
 
 // Handle OPTIONS request
 if ($_SERVER['REQUEST_METHOD'] == 'OPTIONS') {
@@ -129,6 +33,108 @@ if ($_SERVER['REQUEST_METHOD'] == 'OPTIONS') {
     exit();
 }
 
+// GET requests: status endpoint and configuration page
+// (must run before the POST-only check below)
+if (isset($_GET['status'])) {
+    $device_id = require_known_device();
+    $particle_csv = device_path($device_id, 'particle_counts.csv');
+    $summary_file = device_path($device_id, 'latest_analysis.json');
+    
+    $status = [
+        'server_time' => $timestamp,
+        'device_id' => $device_id,
+        'devices' => device_list(),
+        'particle_data_available' => file_exists($particle_csv),
+        'voltage_data_available' => file_exists(device_path($device_id, 'voltage_data.csv')),
+        'encryption_enabled' => true,
+        'last_particle_measurement' => null,
+        'total_measurements' => 0
+    ];
+    
+    if (file_exists($summary_file)) {
+        $latest = json_decode(file_get_contents($summary_file), true);
+        $status['last_particle_measurement'] = $latest;
+    }
+    
+    if (file_exists($particle_csv)) {
+        // Row count comes from the offset index, not a full file read
+        $status['total_measurements'] = csv_index_count($particle_csv);
+    }
+    
+    echo json_encode($status, JSON_PRETTY_PRINT);
+    exit();
+}
+
+// Show encryption configuration if accessed directly
+if ($_SERVER['REQUEST_METHOD'] === 'GET' && !isset($_GET['status'])) {
+    ?>
+    <!DOCTYPE html>
+    <html>
+    <head>
+        <title>Particle Counter - Encryption Configuration</title>
+        <style>
+            body { font-family: Arial, sans-serif; margin: 40px; background: #f5f5f5; }
+            .container { background: white; padding: 30px; border-radius: 10px; max-width: 800px; margin: 0 auto; }
+            .status { padding: 15px; border-radius: 5px; margin: 20px 0; }
+            .status.success { background: #d4edda; border: 1px solid #c3e6cb; color: #155724; }
+            .status.warning { background: #fff3cd; border: 1px solid #ffeaa7; color: #856404; }
+            .status.error { background: #f8d7da; border: 1px solid #f5c6cb; color: #721c24; }
+            .code { background: #f8f9fa; padding: 15px; border-radius: 5px; font-family: monospace; margin: 10px 0; }
+            h1 { color: #333; }
+            h2 { color: #666; border-bottom: 2px solid #667eea; padding-bottom: 10px; }
+        </style>
+    </head>
+    <body>
+        <div class="container">
+            <h1>🔒 Particle Counter Encryption Status</h1>
+            
+            <?php if (!file_exists($DEVICES_FILE)): ?>
+                <div class="status error">
+                    <strong>⚠️ Configuration Required</strong><br>
+                    No devices.json found. Only the built-in default device (<?php echo htmlspecialchars($DEVICES_FALLBACK_ID); ?>) is accepted.
+                </div>
+            <?php else: ?>
+                <div class="status success">
+                    <strong>✅ Encryption Configured</strong><br>
+                    <?php foreach (device_list() as $device): ?>
+                        Device ID: <?php echo htmlspecialchars($device['id'] . ' (' . $device['name'] . ')'); ?><br>
+                    <?php endforeach; ?>
+                </div>
+            <?php endif; ?>
+            
+            <h2>Setup Instructions</h2>
+            
+            <h3>1. Get Your Pico's Device ID</h3>
+            <p>When your Pico starts up, it will print its device ID in the console. Look for output like:</p>
+            <div class="code">Device ID: a1b2c3d4e5f6a7b8</div>
+            
+            <h3>2. Add It to the Device Table</h3>
+            <p>Add one entry per Pico to <code>devices.json</code> (see <code>devices.json.example</code>):</p>
+            <div class="code">{ "a1b2c3d4e5f6a7b8": { "name": "Lab bench" } }</div>
+            
+            <h3>3. Verify Connection</h3>
+            <p>Once configured, your Pico will send encrypted data and you should see "ENCRYPTED" in the logs.</p>
+            
+            <h2>Security Features</h2>
+            <ul>
+                <li><strong>XTEA-64 encryption</strong> - Lightweight, secure block cipher</li>
+                <li><strong>Device-specific keys</strong> - Each Pico has a unique encryption key</li>
+                <li><strong>Backward compatibility</strong> - Still accepts unencrypted data during testing</li>
+                <li><strong>Transmission verification</strong> - Logs show encryption status for each measurement</li>
+            </ul>
+            
+            <h2>Current Status</h2>
+            <p><strong>Encryption:</strong> <?php echo file_exists($DEVICES_FILE) ? "✅ Ready (" . count(device_table()) . " device(s))" : "❌ Needs Configuration"; ?></p>
+            <p><strong>Server Time:</strong> <?php echo $timestamp; ?></p>
+            
+            <p><a href="?status">View detailed status (JSON)</a></p>
+        </div>
+    </body>
+    </html>
+    <?php
+    exit();
+}
+
 // Only accept POST
 if ($_SERVER['REQUEST_METHOD'] !== 'POST') {
     echo json_encode(['error' => 'Method not allowed']);
@@ -137,19 +143,28 @@ if ($_SERVER['REQUEST_METHOD'] !== 'POST') {
 
 // Get POST data
 $input = file_get_contents('php://input');
-file_put_contents($debug_log, "[$timestamp] Raw input length: " . strlen($input) . "\n", FILE_APPEND);
+debug_log('debug', "Raw input length: " . strlen($input));
 
 if (empty($input)) {
     echo json_encode(['error' => 'No POST data received']);
     exit();
 }
 
+// Identify the device; older firmware without the header maps to the default
+$device_id = device_from_request();
+if (!device_known($device_id)) {
+    http_response_code(403);
+    debug_log('error', "Rejected unknown device $device_id from " . ($_SERVER['REMOTE_ADDR'] ?? 'unknown'));
+    echo json_encode(['status' => 'error', 'message' => 'Unknown device']);
+    exit();
+}
+
 $data = null;
 
 try {
     // Check if data is encrypted
     if (is_encrypted_request()) {
-        file_put_contents($debug_log, "[$timestamp] Processing encrypted request\n", FILE_APPEND);
+        debug_log('debug', "Processing encrypted request");
         
         // Decode base64
         $encrypted_binary = base64_decode($input);
@@ -157,14 +172,13 @@ try {
             throw new Exception("Failed to decode base64 data");
         }
         
-        file_put_contents($debug_log, "[$timestamp] Decoded " . strlen($encrypted_binary) . " bytes of encrypted data\n", FILE_APPEND);
-        
-        // Generate decryption key
-        $xtea_key = generate_xtea_key($DEVICE_ID);
+        debug_log('debug', "Decoded " . strlen($encrypted_binary) . " bytes of encrypted data");
         
-        // Decrypt the data
-        $decrypted_json = decrypt_xtea_data($encrypted_binary, $xtea_key);
-        file_put_contents($debug_log, "[$timestamp] Decrypted JSON: " . substr($decrypted_json, 0, 200) . "...\n", FILE_APPEND);
+        // Decrypt with the device's cached key
+        $decrypted_json = decrypt_xtea_data($encrypted_binary, device_xtea_key($device_id));
+        if (log_enabled('debug')) {
+            debug_log('debug', "Decrypted JSON: " . substr($decrypted_json, 0, 200) . "...");
+        }
         
         // Parse decrypted JSON
         $data = json_decode($decrypted_json, true);
@@ -172,11 +186,11 @@ try {
             throw new Exception("Failed to parse decrypted JSON: " . json_last_error_msg());
         }
         
-        file_put_contents($debug_log, "[$timestamp] Successfully decrypted and parsed data\n", FILE_APPEND);
+        debug_log('debug', "Successfully decrypted and parsed data");
         
     } else {
         // Handle unencrypted data (for backward compatibility)
-        file_put_contents($debug_log, "[$timestamp] Processing unencrypted request\n", FILE_APPEND);
+        debug_log('debug', "Processing unencrypted request");
         $data = json_decode($input, true);
         if ($data === null) {
             throw new Exception("Invalid JSON: " . json_last_error_msg());
@@ -190,7 +204,7 @@ try {
         'message' => 'Decryption/parsing error: ' . $e->getMessage(),
         'encrypted' => is_encrypted_request()
     ];
-    file_put_contents($debug_log, "[$timestamp] DECRYPTION ERROR: " . $e->getMessage() . "\n", FILE_APPEND);
+    debug_log('error', "DECRYPTION ERROR: " . $e->getMessage());
     echo json_encode($error_response);
     exit();
 }
@@ -199,17 +213,18 @@ try {
 $data['server_timestamp'] = $timestamp;
 $data['server_unix_timestamp'] = time();
 $data['was_encrypted'] = is_encrypted_request();
+$data['device_id'] = $device_id;
 
 // Handle different data types
 $data_type = $data['type'] ?? 'voltage_data';
 
 try {
     if ($data_type === 'particle_count') {
-        $result = handle_particle_count_data($data, $timestamp);
+        $result = handle_particle_count_data($data, $timestamp, $device_id);
         $message = 'Particle count data processed successfully';
     } else {
         // Legacy voltage data
-        $result = handle_voltage_data($data, $timestamp);
+        $result = handle_voltage_data($data, $timestamp, $device_id);
         $message = 'Voltage data processed successfully';
     }
     
@@ -217,6 +232,7 @@ try {
         'status' => 'success',
         'message' => $message,
         'data_type' => $data_type,
+        'device_id' => $device_id,
         'records_created' => $result['records_created'] ?? 1,
         'server_time' => $timestamp,
         'encrypted' => is_encrypted_request()
@@ -234,23 +250,114 @@ try {
         'data_type' => $data_type,
         'encrypted' => is_encrypted_request()
     ];
-    file_put_contents($debug_log, "[$timestamp] ERROR: " . $e->getMessage() . "\n", FILE_APPEND);
+    debug_log('error', "ERROR: " . $e->getMessage());
+}
+
+if ($response['status'] === 'success') {
+    $log_message = (is_encrypted_request() ? "ENCRYPTED $data_type processed" : "$data_type processed") . " for $device_id";
+    debug_log('info', "SUCCESS: $log_message");
 }
 
-$log_message = is_encrypted_request() ? "ENCRYPTED $data_type processed" : "$data_type processed";
-file_put_contents($debug_log, "[$timestamp] SUCCESS: $log_message\n", FILE_APPEND);
+// All log output goes out in one append per file, then report the cost
+// of the whole request (parse, decrypt, stores and logs)
+log_flush();
+$response['processing_ms'] = round((microtime(true) - $request_start) * 1000, 3);
 echo json_encode($response, JSON_PRETTY_PRINT);
 
-function handle_particle_count_data($data, $timestamp) {
-    // Store particle counting results in CSV
-    $particle_csv = 'particle_counts.csv';
-    
-    // Create header if file doesn't exist
-    if (!file_exists($particle_csv)) {
-        $header = "server_timestamp,device_timestamp,counting_duration_sec,sensor1_particles,sensor2_particles,sensor1_concentration_per_min,sensor2_concentration_per_min,sensor1_baseline,sensor2_baseline,avg_sensor1_voltage,avg_sensor2_voltage,sensor1_false_positives,sensor2_false_positives,detection_threshold_percent,measurement_quality,calibrated,was_encrypted\n";
-        file_put_contents($particle_csv, $header);
+// Poisson confidence interval for an observed count (Byar's approximation,
+// same formula as poisson_confidence_interval() in the firmware)
+function poisson_confidence_interval($count, $z = 1.96) {
+    $lower = 0.0;
+    if ($count > 0) {
+        $a = 1 - 1 / (9 * $count) - $z / (3 * sqrt($count));
+        $lower = $count * $a * $a * $a;
+    }
+    
+    $n1 = $count + 1;
+    $b = 1 - 1 / (9 * $n1) + $z / (3 * sqrt($n1));
+    return [$lower, $n1 * $b * $b * $b];
+}
+
+// Concentration band (particles/min) used for sample classification
+function concentration_band($concentration) {
+    if ($concentration < 10) return "LOW_DENSITY";
+    if ($concentration < 100) return "MODERATE_DENSITY";
+    return "HIGH_DENSITY";
+}
+
+// Classify a measurement using the confidence interval of the combined
+// count, so a band is only reported as certain when the whole interval
+// falls inside it
+function classify_particle_sample($data) {
+    $total_particles = ($data['sensor1_particles'] ?? 0) + ($data['sensor2_particles'] ?? 0);
+    $avg_concentration = (($data['sensor1_concentration_per_min'] ?? 0) + 
+                         ($data['sensor2_concentration_per_min'] ?? 0)) / 2;
+    
+    // Prefer the exact duration reported by adaptive counting firmware
+    $duration_min = isset($data['counting_duration_ms']) ?
+                    $data['counting_duration_ms'] / 60000.0 :
+                    ($data['counting_duration_sec'] ?? 0) / 60.0;
+    
+    // Reported concentrations are dead-time corrected; scale the interval alike
+    $raw_concentration = ($data['sensor1_raw_concentration_per_min'] ?? 0) +
+                         ($data['sensor2_raw_concentration_per_min'] ?? 0);
+    $correction = $raw_concentration > 0 ? (2 * $avg_concentration) / $raw_concentration : 1.0;
+    
+    // Average of two sensors: combined count over twice the duration
+    $ci_lower = 0.0;
+    $ci_upper = 0.0;
+    if ($duration_min > 0) {
+        list($count_lower, $count_upper) = poisson_confidence_interval($total_particles);
+        $ci_lower = $count_lower * $correction / (2 * $duration_min);
+        $ci_upper = $count_upper * $correction / (2 * $duration_min);
+    }
+    
+    $point_band = $total_particles == 0 ? "CLEAN" : concentration_band($avg_concentration);
+    $lower_band = $total_particles == 0 ? "CLEAN" : concentration_band($ci_lower);
+    $upper_band = concentration_band($ci_upper);
+    if ($total_particles == 0 && $upper_band === "LOW_DENSITY") {
+        $upper_band = "CLEAN";
     }
     
+    $interpretations = [
+        "CLEAN" => "CLEAN SAMPLE - No particles detected",
+        "LOW_DENSITY" => "LOW PARTICLE DENSITY - Very clean sample",
+        "MODERATE_DENSITY" => "MODERATE PARTICLE DENSITY - Some contamination",
+        "HIGH_DENSITY" => "HIGH PARTICLE DENSITY - Significant contamination"
+    ];
+    
+    $certain = ($lower_band === $upper_band) || $duration_min <= 0;
+    $interpretation = $interpretations[$point_band];
+    if (!$certain) {
+        $interpretation .= " (95% CI spans $lower_band to $upper_band - measure longer for a firm result)";
+    }
+    
+    return [
+        'total_particles' => $total_particles,
+        'avg_concentration' => $avg_concentration,
+        'ci_lower' => $ci_lower,
+        'ci_upper' => $ci_upper,
+        'classification' => $point_band,
+        'classification_range' => $certain ? $point_band : "$lower_band-$upper_band",
+        'classification_certain' => $certain,
+        'interpretation' => $interpretation
+    ];
+}
+
+function handle_particle_count_data($data, $timestamp, $device_id) {
+    // Store particle counting results in the device's own CSV
+    $particle_csv = device_path($device_id, 'particle_counts.csv');
+    
+    // Classify up front so the interval-based result is stored with the row
+    $sample = classify_particle_sample($data);
+    $total_particles = $sample['total_particles'];
+    $avg_concentration = $sample['avg_concentration'];
+    $classification = $sample['classification'];
+    $interpretation = $sample['interpretation'];
+    
+    // Header is written with the first row
+    $header = "server_timestamp,device_timestamp,counting_duration_sec,sensor1_particles,sensor2_particles,sensor1_concentration_per_min,sensor2_concentration_per_min,sensor1_baseline,sensor2_baseline,avg_sensor1_voltage,avg_sensor2_voltage,sensor1_false_positives,sensor2_false_positives,detection_threshold_percent,measurement_quality,calibrated,was_encrypted,counting_duration_ms,termination_reason,sensor1_ci_lower_per_min,sensor1_ci_upper_per_min,sensor2_ci_lower_per_min,sensor2_ci_upper_per_min,avg_ci_lower_per_min,avg_ci_upper_per_min,classification,classification_certain,sensor1_raw_concentration_per_min,sensor2_raw_concentration_per_min,sensor1_pileup_events,sensor2_pileup_events,sensor1_dead_time_percent,sensor2_dead_time_percent,saturated\n";
+    
     // Prepare CSV data (including encryption status)
     $csv_line = implode(',', [
         '"' . $timestamp . '"',
@@ -269,26 +376,65 @@ function handle_particle_count_data($data, $timestamp) {
         $data['detection_threshold_percent'] ?? 0,
         '"' . ($data['measurement_quality'] ?? 'unknown') . '"',
         '"' . ($data['calibrated'] ?? 'false') . '"',
-        '"' . ($data['was_encrypted'] ? 'true' : 'false') . '"'
+        '"' . ($data['was_encrypted'] ? 'true' : 'false') . '"',
+        $data['counting_duration_ms'] ?? (($data['counting_duration_sec'] ?? 0) * 1000),
+        '"' . ($data['termination_reason'] ?? 'fixed') . '"',
+        $data['sensor1_ci_lower_per_min'] ?? 0,
+        $data['sensor1_ci_upper_per_min'] ?? 0,
+        $data['sensor2_ci_lower_per_min'] ?? 0,
+        $data['sensor2_ci_upper_per_min'] ?? 0,
+        round($sample['ci_lower'], 2),
+        round($sample['ci_upper'], 2),
+        '"' . $sample['classification_range'] . '"',
+        '"' . ($sample['classification_certain'] ? 'true' : 'false') . '"',
+        $data['sensor1_raw_concentration_per_min'] ?? ($data['sensor1_concentration_per_min'] ?? 0),
+        $data['sensor2_raw_concentration_per_min'] ?? ($data['sensor2_concentration_per_min'] ?? 0),
+        $data['sensor1_pileup_events'] ?? 0,
+        $data['sensor2_pileup_events'] ?? 0,
+        $data['sensor1_dead_time_percent'] ?? 0,
+        $data['sensor2_dead_time_percent'] ?? 0,
+        '"' . (!empty($data['saturated']) ? 'true' : 'false') . '"'
     ]) . "\n";
     
-    file_put_contents($particle_csv, $csv_line, FILE_APPEND | LOCK_EX);
+    if (!csv_append_indexed($particle_csv, $csv_line, $header)) {
+        throw new Exception("Cannot store row in particle_counts.csv");
+    }
+    
+    // Fold the period into the minute/hour/day rollups
+    rollup_ingest(device_path($device_id, 'particle_counts'), time(), $data['sensor1_particles'] ?? 0, $data['sensor2_particles'] ?? 0,
+                  $data['counting_duration_ms'] ?? (($data['counting_duration_sec'] ?? 0) * 1000));
     
     // Create detailed human-readable log entry
-    $log_file = 'particle_analysis.log';
+    $log_file = device_path($device_id, 'particle_analysis.log');
     $log_entry = "[$timestamp] PARTICLE COUNT ANALYSIS" . ($data['was_encrypted'] ? " (ENCRYPTED)" : " (UNENCRYPTED)") . "\n";
     $log_entry .= "==========================================\n";
-    $log_entry .= "Duration: " . ($data['counting_duration_sec'] ?? 0) . " seconds\n";
+    $log_entry .= "Duration: " . ($data['counting_duration_sec'] ?? 0) . " seconds" .
+                  (isset($data['termination_reason']) ? " (" . $data['termination_reason'] . ")" : "") . "\n";
     $log_entry .= "Sensor 1: " . ($data['sensor1_particles'] ?? 0) . " particles (" . 
                   number_format($data['sensor1_concentration_per_min'] ?? 0, 1) . "/min)\n";
     $log_entry .= "Sensor 2: " . ($data['sensor2_particles'] ?? 0) . " particles (" . 
                   number_format($data['sensor2_concentration_per_min'] ?? 0, 1) . "/min)\n";
-    
-    $total_particles = ($data['sensor1_particles'] ?? 0) + ($data['sensor2_particles'] ?? 0);
     $log_entry .= "Total Particles: " . $total_particles . "\n";
     
     $log_entry .= "False Positives: S1=" . ($data['sensor1_false_positives'] ?? 0) . 
                   ", S2=" . ($data['sensor2_false_positives'] ?? 0) . "\n";
+    if (isset($data['sensor1_dead_time_percent'])) {
+        $log_entry .= "Pile-up: S1=" . ($data['sensor1_pileup_events'] ?? 0) . " split events, " .
+                      number_format($data['sensor1_dead_time_percent'], 1) . "% dead time; S2=" .
+                      ($data['sensor2_pileup_events'] ?? 0) . " split events, " .
+                      number_format($data['sensor2_dead_time_percent'] ?? 0, 1) . "% dead time\n";
+    }
+    if (!empty($data['saturated'])) {
+        $log_entry .= "SATURATION: Detector saturated - dead-time correction unreliable, dilute the sample\n";
+    }
+    if (!empty($data['link_outages']) || !empty($data['upload_failures']) || !empty($data['watchdog_reset'])) {
+        $log_entry .= "Link: " . ($data['link_outages'] ?? 0) . " outage(s), last " .
+                      number_format(($data['last_outage_ms'] ?? 0) / 1000, 1) . "s, total " .
+                      number_format(($data['total_outage_ms'] ?? 0) / 1000, 1) . "s, " .
+                      ($data['uploads_dropped'] ?? 0) . " upload(s) dropped, " .
+                      ($data['upload_failures'] ?? 0) . " failed POST(s)" .
+                      (!empty($data['watchdog_reset']) ? ", last boot after WATCHDOG RESET" : "") . "\n";
+    }
     $log_entry .= "Detection Quality: " . ($data['measurement_quality'] ?? 'unknown') . "\n";
     $log_entry .= "Baseline Voltages: S1=" . number_format($data['sensor1_baseline'] ?? 0, 4) . 
                   "V, S2=" . number_format($data['sensor2_baseline'] ?? 0, 4) . "V\n";
@@ -296,27 +442,12 @@ function handle_particle_count_data($data, $timestamp) {
                   "V, S2=" . number_format($data['avg_sensor2_voltage'] ?? 0, 4) . "V\n";
     $log_entry .= "Data Security: " . ($data['was_encrypted'] ? "🔒 Encrypted" : "⚠️ Unencrypted") . "\n";
     
-    // Calculate sample interpretation
-    $avg_concentration = (($data['sensor1_concentration_per_min'] ?? 0) + 
-                         ($data['sensor2_concentration_per_min'] ?? 0)) / 2;
-    
-    if ($total_particles == 0) {
-        $interpretation = "CLEAN SAMPLE - No particles detected";
-        $classification = "CLEAN";
-    } elseif ($avg_concentration < 10) {
-        $interpretation = "LOW PARTICLE DENSITY - Very clean sample";
-        $classification = "LOW_DENSITY";
-    } elseif ($avg_concentration < 100) {
-        $interpretation = "MODERATE PARTICLE DENSITY - Some contamination";
-        $classification = "MODERATE_DENSITY";
-    } else {
-        $interpretation = "HIGH PARTICLE DENSITY - Significant contamination";
-        $classification = "HIGH_DENSITY";
-    }
-    
     $log_entry .= "Average Concentration: " . number_format($avg_concentration, 1) . " particles/min\n";
+    $log_entry .= "95% Confidence Interval: " . number_format($sample['ci_lower'], 1) . " - " .
+                  number_format($sample['ci_upper'], 1) . " particles/min\n";
     $log_entry .= "INTERPRETATION: " . $interpretation . "\n";
-    $log_entry .= "CLASSIFICATION: " . $classification . "\n";
+    $log_entry .= "CLASSIFICATION: " . $classification .
+                  ($sample['classification_certain'] ? "" : " (uncertain: " . $sample['classification_range'] . ")") . "\n";
     
     // Add quality assessment
     $quality_num = floatval(str_replace('%', '', $data['measurement_quality'] ?? '0'));
@@ -361,22 +492,41 @@ function handle_particle_count_data($data, $timestamp) {
     
     $log_entry .= "==========================================\n\n";
     
-    file_put_contents($log_file, $log_entry, FILE_APPEND | LOCK_EX);
+    log_write($log_file, $log_entry);
     
     // Store summary data for quick access
-    $summary_file = 'latest_analysis.json';
+    $summary_file = device_path($device_id, 'latest_analysis.json');
     $summary_data = [
         'timestamp' => $timestamp,
+        'device_id' => $device_id,
         'total_particles' => $total_particles,
         'avg_concentration' => $avg_concentration,
+        'ci_lower' => round($sample['ci_lower'], 2),
+        'ci_upper' => round($sample['ci_upper'], 2),
         'classification' => $classification,
+        'classification_range' => $sample['classification_range'],
+        'classification_certain' => $sample['classification_certain'],
         'interpretation' => $interpretation,
+        'termination_reason' => $data['termination_reason'] ?? 'fixed',
+        'saturated' => !empty($data['saturated']),
+        'fast_boot' => !empty($data['fast_boot']),
+        'time_to_first_count_ms' => $data['time_to_first_count_ms'] ?? null,
+        'link' => [
+            'transitions' => $data['link_transitions'] ?? 0,
+            'outages' => $data['link_outages'] ?? 0,
+            'last_outage_ms' => $data['last_outage_ms'] ?? 0,
+            'total_outage_ms' => $data['total_outage_ms'] ?? 0,
+            'reconnect_attempts' => $data['reconnect_attempts'] ?? 0,
+            'uploads_dropped' => $data['uploads_dropped'] ?? 0,
+            'upload_failures' => $data['upload_failures'] ?? 0,
+            'watchdog_reset' => !empty($data['watchdog_reset'])
+        ],
         'quality' => $data['measurement_quality'] ?? 'unknown',
         'duration_sec' => $data['counting_duration_sec'] ?? 0,
         'calibrated' => $data['calibrated'] ?? 'false',
         'encrypted' => $data['was_encrypted'] ?? false
     ];
-    file_put_contents($summary_file, json_encode($summary_data, JSON_PRETTY_PRINT));
+    file_put_contents($summary_file, json_encode($summary_data, JSON_PRETTY_PRINT), LOCK_EX);
     
     return [
         'records_created' => 1, 
@@ -385,14 +535,11 @@ function handle_particle_count_data($data, $timestamp) {
     ];
 }
 
-function handle_voltage_data($data, $timestamp) {
+function handle_voltage_data($data, $timestamp, $device_id) {
     // Handle legacy voltage data (for backward compatibility)
-    $voltage_csv = 'voltage_data.csv';
+    $voltage_csv = device_path($device_id, 'voltage_data.csv');
     
-    if (!file_exists($voltage_csv)) {
-        $header = "server_timestamp,sensor1_raw,sensor1_voltage,sensor2_raw,sensor2_voltage,device_timestamp,was_encrypted\n";
-        file_put_contents($voltage_csv, $header);
-    }
+    $header = "server_timestamp,sensor1_raw,sensor1_voltage,sensor2_raw,sensor2_voltage,device_timestamp,was_encrypted\n";
     
     $csv_line = implode(',', [
         '"' . $timestamp . '"',
@@ -404,110 +551,18 @@ function handle_voltage_data($data, $timestamp) {
         '"' . ($data['was_encrypted'] ? 'true' : 'false') . '"'
     ]) . "\n";
     
-    file_put_contents($voltage_csv, $csv_line, FILE_APPEND | LOCK_EX);
+    if (!csv_append_indexed($voltage_csv, $csv_line, $header)) {
+        throw new Exception("Cannot store row in voltage_data.csv");
+    }
     
     // Log voltage data
-    $voltage_log = 'voltage_readings.log';
+    $voltage_log = device_path($device_id, 'voltage_readings.log');
     $encryption_status = $data['was_encrypted'] ? " (ENCRYPTED)" : " (UNENCRYPTED)";
     $log_entry = "[$timestamp] Voltage Reading$encryption_status: S1=" . 
                  number_format($data['sensor1_voltage'] ?? 0, 3) . "V, S2=" .
                  number_format($data['sensor2_voltage'] ?? 0, 3) . "V\n";
-    file_put_contents($voltage_log, $log_entry, FILE_APPEND | LOCK_EX);
+    log_write($voltage_log, $log_entry);
     
     return ['records_created' => 1];
 }
-
-// Optional: Add a simple status endpoint
-if (isset($_GET['status'])) {
-    $status = [
-        'server_time' => $timestamp,
-        'particle_data_available' => file_exists('particle_counts.csv'),
-        'voltage_data_available' => file_exists('voltage_data.csv'),
-        'encryption_enabled' => true,
-        'device_id_configured' => !empty($DEVICE_ID) && $DEVICE_ID !== "0123456789abcdef",
-        'last_particle_measurement' => null,
-        'total_measurements' => 0
-    ];
-    
-    if (file_exists('latest_analysis.json')) {
-        $latest = json_decode(file_get_contents('latest_analysis.json'), true);
-        $status['last_particle_measurement'] = $latest;
-    }
-    
-    if (file_exists('particle_counts.csv')) {
-        $lines = file('particle_counts.csv');
-        $status['total_measurements'] = count($lines) - 1; // Subtract header
-    }
-    
-    echo json_encode($status, JSON_PRETTY_PRINT);
-    exit();
-}
-
-// Show encryption configuration if accessed directly
-if ($_SERVER['REQUEST_METHOD'] === 'GET' && !isset($_GET['status'])) {
-    ?>
-    <!DOCTYPE html>
-    <html>
-    <head>
-        <title>Particle Counter - Encryption Configuration</title>
-        <style>
-            body { font-family: Arial, sans-serif; margin: 40px; background: #f5f5f5; }
-            .container { background: white; padding: 30px; border-radius: 10px; max-width: 800px; margin: 0 auto; }
-            .status { padding: 15px; border-radius: 5px; margin: 20px 0; }
-            .status.success { background: #d4edda; border: 1px solid #c3e6cb; color: #155724; }
-            .status.warning { background: #fff3cd; border: 1px solid #ffeaa7; color: #856404; }
-            .status.error { background: #f8d7da; border: 1px solid #f5c6cb; color: #721c24; }
-            .code { background: #f8f9fa; padding: 15px; border-radius: 5px; font-family: monospace; margin: 10px 0; }
-            h1 { color: #333; }
-            h2 { color: #666; border-bottom: 2px solid #667eea; padding-bottom: 10px; }
-        </style>
-    </head>
-    <body>
-        <div class="container">
-            <h1>🔒 Particle Counter Encryption Status</h1>
-            
-            <?php if ($DEVICE_ID === "0123456789abcdef"): ?>
-                <div class="status error">
-                    <strong>⚠️ Configuration Required</strong><br>
-                    Default device ID detected. You need to configure your Pico's actual device ID.
-                </div>
-            <?php else: ?>
-                <div class="status success">
-                    <strong>✅ Encryption Configured</strong><br>
-                    Device ID: <?php echo htmlspecialchars($DEVICE_ID); ?>
-                </div>
-            <?php endif; ?>
-            
-            <h2>Setup Instructions</h2>
-            
-            <h3>1. Get Your Pico's Device ID</h3>
-            <p>When your Pico starts up, it will print its device ID in the console. Look for output like:</p>
-            <div class="code">Device ID: a1b2c3d4e5f6a7b8</div>
-            
-            <h3>2. Update PHP Configuration</h3>
-            <p>Edit <code>receive_data.php</code> and update this line with your actual device ID:</p>
-            <div class="code">$DEVICE_ID = "a1b2c3d4e5f6a7b8"; // Replace with your actual device ID</div>
-            
-            <h3>3. Verify Connection</h3>
-            <p>Once configured, your Pico will send encrypted data and you should see "ENCRYPTED" in the logs.</p>
-            
-            <h2>Security Features</h2>
-            <ul>
-                <li><strong>XTEA-64 encryption</strong> - Lightweight, secure block cipher</li>
-                <li><strong>Device-specific keys</strong> - Each Pico has a unique encryption key</li>
-                <li><strong>Backward compatibility</strong> - Still accepts unencrypted data during testing</li>
-                <li><strong>Transmission verification</strong> - Logs show encryption status for each measurement</li>
-            </ul>
-            
-            <h2>Current Status</h2>
-            <p><strong>Encryption:</strong> <?php echo $DEVICE_ID !== "0123456789abcdef" ? "✅ Ready" : "❌ Needs Configuration"; ?></p>
-            <p><strong>Server Time:</strong> <?php echo $timestamp; ?></p>
-            
-            <p><a href="?status">View detailed status (JSON)</a></p>
-        </div>
-    </body>
-    </html>
-    <?php
-    exit();
-}
 ?>
\ No newline at end of file
@@ -0,0 +1,216 @@
+<?php
+// Downsampled rollup tiers for long-range history
+//
+// Every particle count period is folded into per-minute, per-hour and
+// per-day buckets as it is received. Each tier is a separate binary file
+// of fixed-size records ordered by bucket start, so a range query is a
+// binary search plus one read of the buckets that will be displayed.
+//
+// Record layout (36 bytes, 9 x uint32 big-endian):
+//   bucket_start, periods, duration_ms,
+//   sensor1 min, max, sum, sensor2 min, max, sum
+// The mean per period is sum / periods.
+//
+// Only the last record of a tier is ever rewritten (while its bucket is
+// still open); everything before it is append-only.
+
+$ROLLUP_TIERS = [
+    'minute' => 60,
+    'hour' => 3600,
+    'day' => 86400
+];
+$ROLLUP_RECORD_SIZE = 36; // Must match pack('N9') in rollup_pack()
+$ROLLUP_RECORD_FORMAT = 'Nstart/Nperiods/Nduration_ms/Ns1_min/Ns1_max/Ns1_sum/Ns2_min/Ns2_max/Ns2_sum';
+
+function rollup_path($prefix, $tier) {
+    return $prefix . '.' . $tier . '.rollup';
+}
+
+function rollup_pack($r) {
+    return pack('N9', $r['start'], $r['periods'], $r['duration_ms'],
+                $r['s1_min'], $r['s1_max'], $r['s1_sum'],
+                $r['s2_min'], $r['s2_max'], $r['s2_sum']);
+}
+
+function rollup_unpack($bytes) {
+    global $ROLLUP_RECORD_FORMAT;
+    return unpack($ROLLUP_RECORD_FORMAT, $bytes);
+}
+
+// Fold one counting period into every tier
+function rollup_ingest($prefix, $unix_time, $sensor1_count, $sensor2_count, $duration_ms) {
+    global $ROLLUP_TIERS, $ROLLUP_RECORD_SIZE;
+    
+    $sensor1_count = max(0, intval($sensor1_count));
+    $sensor2_count = max(0, intval($sensor2_count));
+    $duration_ms = max(0, intval($duration_ms));
+    
+    foreach ($ROLLUP_TIERS as $tier => $step) {
+        $fp = fopen(rollup_path($prefix, $tier), 'c+');
+        if (!$fp) continue;
+        flock($fp, LOCK_EX);
+        
+        $start = $unix_time - ($unix_time % $step);
+        
+        fseek($fp, 0, SEEK_END);
+        $size = ftell($fp);
+        $size -= $size % $ROLLUP_RECORD_SIZE; // Ignore a torn trailing record
+        
+        $last = null;
+        if ($size >= $ROLLUP_RECORD_SIZE) {
+            fseek($fp, $size - $ROLLUP_RECORD_SIZE);
+            $last = rollup_unpack(fread($fp, $ROLLUP_RECORD_SIZE));
+        }
+        
+        // Same bucket, or clock went backwards: update the open bucket.
+        // Buckets must stay ordered for the binary search.
+        if ($last && $start <= $last['start']) {
+            $last['periods'] += 1;
+            $last['duration_ms'] += $duration_ms;
+            $last['s1_min'] = min($last['s1_min'], $sensor1_count);
+            $last['s1_max'] = max($last['s1_max'], $sensor1_count);
+            $last['s1_sum'] += $sensor1_count;
+            $last['s2_min'] = min($last['s2_min'], $sensor2_count);
+            $last['s2_max'] = max($last['s2_max'], $sensor2_count);
+            $last['s2_sum'] += $sensor2_count;
+            fseek($fp, $size - $ROLLUP_RECORD_SIZE);
+            fwrite($fp, rollup_pack($last));
+        } else {
+            fseek($fp, $size);
+            fwrite($fp, rollup_pack([
+                'start' => $start,
+                'periods' => 1,
+                'duration_ms' => $duration_ms,
+                's1_min' => $sensor1_count,
+                's1_max' => $sensor1_count,
+                's1_sum' => $sensor1_count,
+                's2_min' => $sensor2_count,
+                's2_max' => $sensor2_count,
+                's2_sum' => $sensor2_count
+            ]));
+        }
+        
+        fflush($fp);
+        flock($fp, LOCK_UN);
+        fclose($fp);
+    }
+}
+
+// Coarsest tier whose bucket is no wider than $resolution seconds
+function rollup_pick_tier($resolution) {
+    global $ROLLUP_TIERS;
+    
+    $chosen = array_key_first($ROLLUP_TIERS);
+    foreach ($ROLLUP_TIERS as $tier => $step) {
+        if ($step <= $resolution) {
+            $chosen = $tier;
+        }
+    }
+    return $chosen;
+}
+
+// Buckets of $tier with $from <= start <= $to (oldest first)
+function rollup_read_range($prefix, $tier, $from, $to) {
+    global $ROLLUP_RECORD_SIZE;
+    
+    $path = rollup_path($prefix, $tier);
+    $fp = @fopen($path, 'r');
+    if (!$fp) return [];
+    flock($fp, LOCK_SH);
+    
+    fseek($fp, 0, SEEK_END);
+    $count = intdiv(ftell($fp), $ROLLUP_RECORD_SIZE);
+    
+    // First record with start >= $from
+    $low = 0;
+    $high = $count;
+    while ($low < $high) {
+        $mid = intdiv($low + $high, 2);
+        fseek($fp, $mid * $ROLLUP_RECORD_SIZE);
+        if (rollup_unpack(fread($fp, $ROLLUP_RECORD_SIZE))['start'] < $from) {
+            $low = $mid + 1;
+        } else {
+            $high = $mid;
+        }
+    }
+    
+    $records = [];
+    fseek($fp, $low * $ROLLUP_RECORD_SIZE);
+    for ($i = $low; $i < $count; $i++) {
+        $record = rollup_unpack(fread($fp, $ROLLUP_RECORD_SIZE));
+        if ($record['start'] > $to) break;
+        $records[] = $record;
+    }
+    
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return $records;
+}
+
+// Merge consecutive buckets so that each output point spans $resolution
+function rollup_merge($records, $resolution) {
+    $points = [];
+    $current = null;
+    
+    foreach ($records as $r) {
+        $start = $r['start'] - ($r['start'] % $resolution);
+        if ($current && $current['start'] === $start) {
+            $current['periods'] += $r['periods'];
+            $current['duration_ms'] += $r['duration_ms'];
+            $current['s1_min'] = min($current['s1_min'], $r['s1_min']);
+            $current['s1_max'] = max($current['s1_max'], $r['s1_max']);
+            $current['s1_sum'] += $r['s1_sum'];
+            $current['s2_min'] = min($current['s2_min'], $r['s2_min']);
+            $current['s2_max'] = max($current['s2_max'], $r['s2_max']);
+            $current['s2_sum'] += $r['s2_sum'];
+        } else {
+            if ($current) $points[] = $current;
+            $current = $r;
+            $current['start'] = $start;
+        }
+    }
+    if ($current) $points[] = $current;
+    
+    return $points;
+}
+
+// Rebuild all tiers from an existing CSV (for history recorded before
+// rollups existed): php rollup.php particle_counts.csv
+function rollup_rebuild_from_csv($csv_file, $prefix) {
+    global $ROLLUP_TIERS;
+    
+    $fp = @fopen($csv_file, 'r');
+    if (!$fp) return 0;
+    
+    foreach ($ROLLUP_TIERS as $tier => $step) {
+        @unlink(rollup_path($prefix, $tier));
+    }
+    
+    $columns = str_getcsv(rtrim(fgets($fp), "\r\n"));
+    $rows = 0;
+    while (($line = fgets($fp)) !== false) {
+        if (trim($line) === '') continue;
+        $values = str_getcsv(rtrim($line, "\r\n"));
+        if (count($values) < count($columns)) continue;
+        $row = array_combine($columns, array_slice($values, 0, count($columns)));
+        
+        $unix_time = strtotime($row['server_timestamp'] ?? '');
+        if ($unix_time === false) continue;
+        $duration_ms = $row['counting_duration_ms'] ?? (($row['counting_duration_sec'] ?? 0) * 1000);
+        
+        rollup_ingest($prefix, $unix_time, $row['sensor1_particles'] ?? 0,
+                      $row['sensor2_particles'] ?? 0, $duration_ms);
+        $rows++;
+    }
+    fclose($fp);
+    
+    return $rows;
+}
+
+if (PHP_SAPI === 'cli' && isset($argv[0]) && realpath($argv[0]) === __FILE__) {
+    $csv_file = $argv[1] ?? 'particle_counts.csv';
+    $prefix = preg_replace('/\.csv$/', '', $csv_file);
+    $rows = rollup_rebuild_from_csv($csv_file, $prefix);
+    echo "Rebuilt rollups for $prefix from $rows rows\n";
+}
+?>
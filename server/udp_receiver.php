@@ -0,0 +1,221 @@
+<?php
+// UDP telemetry receiver for the particle counter
+// Run from the server directory: php udp_receiver.php [port]
+//
+// Datagram layout (see send_udp_telemetry() in LASER_INIT.c):
+//   bytes 0-1  magic "PC"
+//   byte  2    protocol version
+//   byte  3    message type (1 = count_tick, 2 = particle_event)
+//   bytes 4-11 device ID (raw, selects the decryption key)
+//   bytes 12.. XTEA-encrypted JSON containing "seq" and "ts"
+//
+// Nothing is acknowledged. Loss is measured from gaps in the sequence numbers.
+// A device restart is detected from "ts" (ms since boot) going backwards:
+// after a fast boot the first sequence numbers are used up before WiFi is
+// up, so seq 0 is usually never received.
+// Devices must be listed in devices.json (read once at startup); data goes
+// to each device's own directory under data/.
+
+require_once __DIR__ . '/devices.php';
+require_once __DIR__ . '/csv_store.php';
+require_once __DIR__ . '/log.php'; // debug.log, flushed with the stats every $STATS_INTERVAL_SEC
+
+$UDP_PORT = intval($argv[1] ?? 8001);
+$UDP_HEADER_SIZE = 12;
+$UDP_PROTOCOL_VERSION = 1;
+$STATS_INTERVAL_SEC = 10;
+$UDP_REORDER_WINDOW_MS = 5000;   // Older "ts" than this means the device rebooted
+
+$tick_csv = 'live_counts.csv';        // Per device, see device_path()
+$event_csv = 'particle_events.csv';
+$stats_file = 'udp_stats.json';
+
+$socket = stream_socket_server("udp://0.0.0.0:$UDP_PORT", $errno, $errstr, STREAM_SERVER_BIND);
+if (!$socket) {
+    fwrite(STDERR, "Cannot bind UDP port $UDP_PORT: $errstr ($errno)\n");
+    exit(1);
+}
+
+echo "Listening for UDP telemetry on port $UDP_PORT\n";
+
+$devices = [];     // Sequence tracking per device
+$window = ['datagrams' => 0, 'bytes' => 0, 'started' => microtime(true)];
+
+while (true) {
+    $read = [$socket];
+    $write = null;
+    $except = null;
+    
+    if (stream_select($read, $write, $except, 1) > 0) {
+        $packet = stream_socket_recvfrom($socket, 1500, 0, $peer);
+        if ($packet !== false && $packet !== '') {
+            $window['datagrams']++;
+            $window['bytes'] += strlen($packet);
+            handle_datagram($packet, $peer);
+        }
+    }
+    
+    if (microtime(true) - $window['started'] >= $STATS_INTERVAL_SEC) {
+        report_stats();
+    }
+}
+
+function handle_datagram($packet, $peer) {
+    global $UDP_HEADER_SIZE, $UDP_PROTOCOL_VERSION, $devices;
+    
+    $timestamp = date('Y-m-d H:i:s');
+    
+    if (strlen($packet) <= $UDP_HEADER_SIZE || substr($packet, 0, 2) !== 'PC' ||
+        ord($packet[2]) !== $UDP_PROTOCOL_VERSION) {
+        debug_log('error', "UDP: malformed datagram from $peer");
+        return;
+    }
+    
+    $device_id = bin2hex(substr($packet, 4, 8));
+    if (!device_known($device_id)) {
+        debug_log('error', "UDP: unknown device $device_id from $peer");
+        return;
+    }
+    
+    try {
+        $json = decrypt_xtea_data(substr($packet, $UDP_HEADER_SIZE), device_xtea_key($device_id));
+        $data = json_decode($json, true);
+        if ($data === null || !isset($data['seq'])) {
+            throw new Exception("Failed to parse decrypted JSON: " . json_last_error_msg());
+        }
+    } catch (Exception $e) {
+        debug_log('error', "UDP DECRYPTION ERROR: " . $e->getMessage());
+        return;
+    }
+    
+    track_sequence($device_id, intval($data['seq']), intval($data['ts'] ?? 0), $timestamp);
+    
+    $data_type = $data['type'] ?? 'unknown';
+    if ($data_type === 'count_tick') {
+        append_count_tick($data, $device_id, $timestamp);
+    } elseif ($data_type === 'particle_event') {
+        append_particle_event($data, $device_id, $timestamp);
+    }
+}
+
+// Detect lost, duplicated and reordered datagrams from sequence numbers
+function track_sequence($device_id, $seq, $ts, $timestamp) {
+    global $devices, $UDP_REORDER_WINDOW_MS;
+    
+    if (!isset($devices[$device_id])) {
+        $devices[$device_id] = [
+            'first_seq' => $seq,
+            'last_seq' => $seq,
+            'last_ts' => $ts,
+            'received' => 1,
+            'lost' => 0,
+            'out_of_order' => 0,
+            'restarts' => 0
+        ];
+        return;
+    }
+    
+    $dev = &$devices[$device_id];
+    $expected = $dev['last_seq'] + 1;
+    
+    if ($ts + $UDP_REORDER_WINDOW_MS < $dev['last_ts']) {
+        // Device rebooted (or its ms counter wrapped): new sequence from
+        // here on. Numbers before $seq were used up before the link was up
+        $dev['restarts']++;
+        $dev['first_seq'] = $seq;
+        $dev['last_seq'] = $seq;
+        $dev['last_ts'] = $ts;
+        $dev['received']++;
+        debug_log('info', "UDP: device $device_id restarted (seq $seq, ts $ts ms)");
+        return;
+    }
+    $dev['last_ts'] = max($dev['last_ts'], $ts);
+    
+    if ($seq === $expected) {
+        $dev['last_seq'] = $seq;
+    } elseif ($seq > $expected) {
+        $gap = $seq - $expected;
+        $dev['lost'] += $gap;
+        $dev['last_seq'] = $seq;
+        debug_log('info', "UDP: $gap datagram(s) lost from $device_id (seq $expected-" . ($seq - 1) . ")");
+    } else {
+        // Late or duplicated datagram: it was already counted as lost
+        $dev['out_of_order']++;
+        if ($dev['lost'] > 0) $dev['lost']--;
+    }
+    
+    $dev['received']++;
+}
+
+function append_count_tick($data, $device_id, $timestamp) {
+    global $tick_csv;
+    
+    $csv_file = device_path($device_id, $tick_csv);
+    $header = "server_timestamp,device_id,seq,device_timestamp,elapsed_ms,sensor1_particles,sensor2_particles,sensor1_concentration_per_min,sensor2_concentration_per_min,events_skipped\n";
+    
+    $csv_line = implode(',', [
+        '"' . $timestamp . '"',
+        '"' . $device_id . '"',
+        $data['seq'] ?? 0,
+        $data['ts'] ?? 0,
+        $data['elapsed_ms'] ?? 0,
+        $data['s1'] ?? 0,
+        $data['s2'] ?? 0,
+        $data['s1_per_min'] ?? 0,
+        $data['s2_per_min'] ?? 0,
+        $data['events_skipped'] ?? 0
+    ]) . "\n";
+    
+    csv_append($csv_file, $csv_line, $header);
+}
+
+function append_particle_event($data, $device_id, $timestamp) {
+    global $event_csv;
+    
+    $csv_file = device_path($device_id, $event_csv);
+    // particles: 1, or the number of particles split from a pile-up event
+    $header = "server_timestamp,device_id,seq,device_timestamp,sensor,duration_ms,drop_percent,period_count,particles\n";
+    
+    $csv_line = implode(',', [
+        '"' . $timestamp . '"',
+        '"' . $device_id . '"',
+        $data['seq'] ?? 0,
+        $data['ts'] ?? 0,
+        $data['sensor'] ?? 0,
+        $data['duration_ms'] ?? 0,
+        $data['drop_percent'] ?? 0,
+        $data['count'] ?? 0,
+        $data['particles'] ?? 1
+    ]) . "\n";
+    
+    csv_append($csv_file, $csv_line, $header);
+}
+
+// Print throughput and loss for the last window and persist totals
+function report_stats() {
+    global $window, $devices, $stats_file;
+    
+    $elapsed = microtime(true) - $window['started'];
+    $stats = [
+        'server_time' => date('Y-m-d H:i:s'),
+        'window_sec' => round($elapsed, 1),
+        'datagrams_per_sec' => round($window['datagrams'] / $elapsed, 2),
+        'bytes_per_sec' => round($window['bytes'] / $elapsed, 1),
+        'devices' => []
+    ];
+    
+    foreach ($devices as $device_id => $dev) {
+        $expected = $dev['received'] + $dev['lost'];
+        $loss_percent = $expected > 0 ? ($dev['lost'] * 100.0 / $expected) : 0;
+        $stats['devices'][$device_id] = $dev + ['loss_percent' => round($loss_percent, 2)];
+        
+        printf("[%s] %s: %.2f dgram/s, %.1f B/s, received=%d lost=%d (%.2f%%)\n",
+               $stats['server_time'], $device_id, $stats['datagrams_per_sec'],
+               $stats['bytes_per_sec'], $dev['received'], $dev['lost'], $loss_percent);
+    }
+    
+    file_put_contents($stats_file, json_encode($stats, JSON_PRETTY_PRINT));
+    log_flush();
+    $window = ['datagrams' => 0, 'bytes' => 0, 'started' => microtime(true)];
+}
+?>
@@ -0,0 +1,103 @@
+<?php
+// XTEA decryption helpers shared by receive_data.php and udp_receiver.php
+// Must stay in sync with the firmware's key derivation and block layout
+
+$XTEA_KEY_SIZE = 16; // 4 x 32-bit words
+$XTEA_BLOCK_SIZE = 8; // 8 bytes per block
+$XTEA_ROUNDS = 32;
+
+// Generate XTEA key from device ID (matching Pico's method)
+function generate_xtea_key($device_id_hex) {
+    global $XTEA_KEY_SIZE;
+    
+    // Convert hex string to bytes
+    $device_bytes = hex2bin($device_id_hex);
+    if (strlen($device_bytes) !== 8) {
+        throw new Exception("Device ID must be exactly 8 bytes (16 hex chars)");
+    }
+    
+    // Generate 4 x 32-bit key words (matching Pico's logic)
+    $key = array();
+    $key[0] = (ord($device_bytes[0]) << 24) | (ord($device_bytes[1]) << 16) | 
+              (ord($device_bytes[2]) << 8) | ord($device_bytes[3]);
+    $key[1] = (ord($device_bytes[4]) << 24) | (ord($device_bytes[5]) << 16) | 
+              (ord($device_bytes[6]) << 8) | ord($device_bytes[7]);
+    $key[2] = $key[0] ^ 0xAAAAAAAA; // Add variety (matching Pico)
+    $key[3] = $key[1] ^ 0x55555555; // Add variety (matching Pico)
+    
+    return $key;
+}
+
+// XTEA decryption function
+function xtea_decrypt_block($data, $key) {
+    global $XTEA_ROUNDS;
+    
+    $v0 = $data[0];
+    $v1 = $data[1];
+    $sum = 0xC6EF3720; // delta * rounds
+    $delta = 0x9E3779B9;
+    
+    for ($i = 0; $i < $XTEA_ROUNDS; $i++) {
+        $v1 = ($v1 - ((($v0 << 4) ^ ($v0 >> 5)) + $v0) ^ ($sum + $key[($sum >> 11) & 3])) & 0xFFFFFFFF;
+        $sum = ($sum - $delta) & 0xFFFFFFFF;
+        $v0 = ($v0 - ((($v1 << 4) ^ ($v1 >> 5)) + $v1) ^ ($sum + $key[$sum & 3])) & 0xFFFFFFFF;
+    }
+    
+    return array($v0, $v1);
+}
+
+// Decrypt XTEA-encrypted data
+function decrypt_xtea_data($encrypted_data, $key) {
+    global $XTEA_BLOCK_SIZE;
+    
+    if (strlen($encrypted_data) % $XTEA_BLOCK_SIZE !== 0) {
+        throw new Exception("Encrypted data length must be multiple of " . $XTEA_BLOCK_SIZE);
+    }
+    
+    $decrypted = '';
+    
+    // Decrypt each 8-byte block
+    for ($i = 0; $i < strlen($encrypted_data); $i += $XTEA_BLOCK_SIZE) {
+        $block_bytes = substr($encrypted_data, $i, $XTEA_BLOCK_SIZE);
+        
+        // Convert bytes to 32-bit words (little endian)
+        $data = array();
+        $data[0] = (ord($block_bytes[3]) << 24) | (ord($block_bytes[2]) << 16) | 
+                   (ord($block_bytes[1]) << 8) | ord($block_bytes[0]);
+        $data[1] = (ord($block_bytes[7]) << 24) | (ord($block_bytes[6]) << 16) | 
+                   (ord($block_bytes[5]) << 8) | ord($block_bytes[4]);
+        
+        // Decrypt block
+        $decrypted_block = xtea_decrypt_block($data, $key);
+        
+        // Convert back to bytes (little endian)
+        $decrypted .= chr($decrypted_block[0] & 0xFF);
+        $decrypted .= chr(($decrypted_block[0] >> 8) & 0xFF);
+        $decrypted .= chr(($decrypted_block[0] >> 16) & 0xFF);
+        $decrypted .= chr(($decrypted_block[0] >> 24) & 0xFF);
+        $decrypted .= chr($decrypted_block[1] & 0xFF);
+        $decrypted .= chr(($decrypted_block[1] >> 8) & 0xFF);
+        $decrypted .= chr(($decrypted_block[1] >> 16) & 0xFF);
+        $decrypted .= chr(($decrypted_block[1] >> 24) & 0xFF);
+    }
+    
+    // Remove padding
+    $padding = ord($decrypted[strlen($decrypted) - 1]);
+    if ($padding > 0 && $padding <= $XTEA_BLOCK_SIZE) {
+        // Verify padding
+        $valid_padding = true;
+        for ($i = strlen($decrypted) - $padding; $i < strlen($decrypted); $i++) {
+            if (ord($decrypted[$i]) !== $padding) {
+                $valid_padding = false;
+                break;
+            }
+        }
+        
+        if ($valid_padding) {
+            $decrypted = substr($decrypted, 0, strlen($decrypted) - $padding);
+        }
+    }
+    
+    return $decrypted;
+}
+?>
\ No newline at end of file
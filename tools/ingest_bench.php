@@ -0,0 +1,91 @@
+<?php
+// Load generator for receive_data.php ingestion
+//
+// Run against a local server (e.g. `php -S localhost:8000 -t server`):
+//   php tools/ingest_bench.php http://localhost:8000/receive_data.php [requests] [workers]
+//
+// Sends unencrypted particle_count payloads from several worker processes
+// and reports client round-trip time and the server-side processing_ms
+// returned in each response.
+
+$url = $argv[1] ?? 'http://localhost:8000/receive_data.php';
+$requests = intval($argv[2] ?? 200);
+$workers = max(1, intval($argv[3] ?? 4));
+
+function sample_payload($i) {
+    $s1 = rand(0, 200);
+    $s2 = rand(0, 200);
+    return json_encode([
+        'type' => 'particle_count',
+        'timestamp' => $i * 60000,
+        'counting_duration_sec' => 60,
+        'counting_duration_ms' => 60000,
+        'sensor1_particles' => $s1,
+        'sensor2_particles' => $s2,
+        'sensor1_concentration_per_min' => $s1,
+        'sensor2_concentration_per_min' => $s2,
+        'sensor1_baseline' => 2.0,
+        'sensor2_baseline' => 2.0,
+        'measurement_quality' => '95.0%',
+        'calibrated' => 'true'
+    ]);
+}
+
+function percentile($values, $p) {
+    if (empty($values)) return 0;
+    sort($values);
+    return $values[min(count($values) - 1, intval(floor($p / 100 * count($values))))];
+}
+
+// Each worker prints "round_trip_ms processing_ms" per request
+if (($argv[4] ?? '') === '--worker') {
+    for ($i = 0; $i < $requests; $i++) {
+        $context = stream_context_create(['http' => [
+            'method' => 'POST',
+            'header' => "Content-Type: application/json\r\n",
+            'content' => sample_payload($i),
+            'ignore_errors' => true
+        ]]);
+        $start = microtime(true);
+        $body = @file_get_contents($url, false, $context);
+        $round_trip = (microtime(true) - $start) * 1000;
+        $response = $body === false ? null : json_decode($body, true);
+        echo round($round_trip, 3) . " " . ($response['processing_ms'] ?? -1) . "\n";
+    }
+    exit(0);
+}
+
+$per_worker = intdiv($requests + $workers - 1, $workers);
+$pipes = [];
+$start = microtime(true);
+for ($w = 0; $w < $workers; $w++) {
+    $cmd = escapeshellarg(PHP_BINARY) . ' ' . escapeshellarg(__FILE__) . ' ' .
+           escapeshellarg($url) . ' ' . $per_worker . ' 1 --worker';
+    $pipes[] = popen($cmd, 'r');
+}
+
+$round_trips = [];
+$processing = [];
+$failed = 0;
+foreach ($pipes as $pipe) {
+    while (($line = fgets($pipe)) !== false) {
+        [$rt, $proc] = array_map('floatval', explode(' ', trim($line)));
+        $round_trips[] = $rt;
+        if ($proc < 0) {
+            $failed++;
+        } else {
+            $processing[] = $proc;
+        }
+    }
+    pclose($pipe);
+}
+$elapsed = microtime(true) - $start;
+
+$total = count($round_trips);
+printf("%d requests, %d workers, %.1f s, %.1f req/s, %d failed\n",
+       $total, $workers, $elapsed, $total / max($elapsed, 0.001), $failed);
+printf("round trip ms:    p50 %.2f  p95 %.2f  max %.2f\n",
+       percentile($round_trips, 50), percentile($round_trips, 95), percentile($round_trips, 100));
+printf("processing_ms:    p50 %.3f  p95 %.3f  max %.3f\n",
+       percentile($processing, 50), percentile($processing, 95), percentile($processing, 100));
+?>
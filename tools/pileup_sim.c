@@ -0,0 +1,160 @@
+// Host simulator for pile-up and dead-time behaviour of the particle detector
+//
+// Build and run from the repository root:
+//   mkdir -p build
+//   gcc -O2 -I. tools/pileup_sim.c particle_detector.c -lm -o build/pileup_sim
+//   ./build/pileup_sim [period_sec] [seed]
+//
+// A Poisson stream of particles is turned into overlapping photodiode dips
+// (raised-cosine pulses plus Gaussian noise) sampled every SAMPLING_RATE_MS.
+// The same stream is fed to the legacy detector (no splitting, no
+// correction) and the current one, and the reported rates are compared
+// against the true rate. Exits non-zero if the corrected rate leaves the
+// linearity tolerance below LINEARITY_MAX_DEAD_PERCENT dead time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "particle_detector.h"
+
+// Keep in sync with LASER_INIT.c
+#define DETECTION_THRESHOLD_PERCENT 8
+#define MIN_PARTICLE_DURATION_MS 3
+#define MAX_PARTICLE_DURATION_MS 100
+#define PILEUP_HYSTERESIS_PERCENT 3
+#define SAMPLING_RATE_MS 2
+
+// Simulated sensor and particles
+#define BASELINE_V 2.0f
+#define NOISE_PERCENT 0.25f            // 1 sigma, fraction of baseline
+#define PULSE_WIDTH_MIN_MS 8.0
+#define PULSE_WIDTH_MAX_MS 20.0
+#define PULSE_DEPTH_MIN 0.15           // Fraction of baseline
+#define PULSE_DEPTH_MAX 0.40
+
+// Corrected rate must stay within +-10% of the true rate up to 80% dead time
+// (for the default 60 s period; shorter runs have fewer live-time pulses
+// and scatter more)
+#define LINEARITY_TOLERANCE 0.10
+#define LINEARITY_MAX_DEAD_PERCENT 80.0
+
+typedef struct {
+    double start_ms;
+    double width_ms;
+    double depth;
+} pulse_t;
+
+static double uniform(void) {
+    return (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+}
+
+static double gaussian(void) {
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+// Generate Poisson arrivals for the whole period
+static size_t generate_pulses(pulse_t *pulses, size_t max_pulses, double rate_per_min, double period_ms) {
+    double rate_per_ms = rate_per_min / 60000.0;
+    double t = 0;
+    size_t n = 0;
+    
+    while (n < max_pulses) {
+        t += -log(uniform()) / rate_per_ms;
+        if (t >= period_ms) break;
+        pulses[n].start_ms = t;
+        pulses[n].width_ms = PULSE_WIDTH_MIN_MS + uniform() * (PULSE_WIDTH_MAX_MS - PULSE_WIDTH_MIN_MS);
+        pulses[n].depth = PULSE_DEPTH_MIN + uniform() * (PULSE_DEPTH_MAX - PULSE_DEPTH_MIN);
+        n++;
+    }
+    return n;
+}
+
+// Photodiode voltage at time t: overlapping dips add up
+static float signal_at(const pulse_t *pulses, size_t count, size_t *first_active, double t) {
+    while (*first_active < count &&
+           pulses[*first_active].start_ms + PULSE_WIDTH_MAX_MS < t) {
+        (*first_active)++;
+    }
+    
+    double drop = 0;
+    for (size_t i = *first_active; i < count && pulses[i].start_ms <= t; i++) {
+        double phase = (t - pulses[i].start_ms) / pulses[i].width_ms;
+        if (phase < 1.0) {
+            drop += pulses[i].depth * 0.5 * (1.0 - cos(2.0 * M_PI * phase));
+        }
+    }
+    if (drop > 1.0) drop = 1.0;
+    
+    return (float)(BASELINE_V * (1.0 - drop) + gaussian() * BASELINE_V * NOISE_PERCENT / 100.0);
+}
+
+static void run_detector(const pulse_t *pulses, size_t count, uint32_t period_ms,
+                         const detector_config_t *config, detection_state_t *state) {
+    size_t first_active = 0;
+    for (uint32_t t = 0; t < period_ms; t += SAMPLING_RATE_MS) {
+        float v = signal_at(pulses, count, &first_active, t);
+        particle_detector_update(state, config, BASELINE_V, v, t);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t period_sec = argc > 1 ? (uint32_t)atoi(argv[1]) : 60;
+    srand(argc > 2 ? (unsigned)atoi(argv[2]) : 1);
+    
+    const detector_config_t legacy = {
+        DETECTION_THRESHOLD_PERCENT, MIN_PARTICLE_DURATION_MS, MAX_PARTICLE_DURATION_MS, 0
+    };
+    const detector_config_t current = {
+        DETECTION_THRESHOLD_PERCENT, MIN_PARTICLE_DURATION_MS, MAX_PARTICLE_DURATION_MS,
+        PILEUP_HYSTERESIS_PERCENT
+    };
+    const double rates[] = { 10, 100, 300, 1000, 2000, 3000, 5000, 7500, 10000, 15000, 20000 };
+    const size_t num_rates = sizeof(rates) / sizeof(rates[0]);
+    
+    uint32_t period_ms = period_sec * 1000;
+    size_t max_pulses = (size_t)(rates[num_rates - 1] / 60.0 * period_sec * 2) + 16;
+    pulse_t *pulses = malloc(max_pulses * sizeof(pulse_t));
+    if (pulses == NULL) return 1;
+    
+    printf("Pile-up simulation: %lu s per rate, pulses %.0f-%.0f ms, sampling %d ms\n\n",
+           (unsigned long)period_sec, PULSE_WIDTH_MIN_MS, PULSE_WIDTH_MAX_MS, SAMPLING_RATE_MS);
+    printf("%10s | %10s %7s | %10s %10s %7s %6s %5s %5s\n",
+           "true/min", "legacy", "ratio", "split", "corrected", "ratio", "dead%", "sat", "lin");
+    printf("-----------+--------------------+---------------------------------------------------\n");
+    
+    int failures = 0;
+    
+    for (size_t r = 0; r < num_rates; r++) {
+        size_t count = generate_pulses(pulses, max_pulses, rates[r], period_ms);
+        double true_rate = count * 60000.0 / period_ms;
+        
+        detection_state_t legacy_state = {0};
+        detection_state_t current_state = {0};
+        run_detector(pulses, count, period_ms, &legacy, &legacy_state);
+        run_detector(pulses, count, period_ms, &current, &current_state);
+        
+        double legacy_rate = legacy_state.valid_events * 60000.0 / period_ms;
+        double split_rate = current_state.valid_events * 60000.0 / period_ms;
+        double corrected_rate = particle_detector_corrected_rate(&current_state, period_ms) * 60000.0;
+        double dead_percent = current_state.dead_time_ms * 100.0 / period_ms;
+        double corrected_ratio = true_rate > 0 ? corrected_rate / true_rate : 1.0;
+        
+        const char *linear = "-";
+        if (dead_percent <= LINEARITY_MAX_DEAD_PERCENT) {
+            bool ok = fabs(corrected_ratio - 1.0) <= LINEARITY_TOLERANCE;
+            if (!ok) failures++;
+            linear = ok ? "ok" : "FAIL";
+        }
+        
+        printf("%10.0f | %10.0f %7.2f | %10.0f %10.0f %7.2f %6.1f %5s %5s\n",
+               true_rate, legacy_rate, true_rate > 0 ? legacy_rate / true_rate : 0,
+               split_rate, corrected_rate, corrected_ratio,
+               dead_percent, dead_percent >= 50.0 ? "yes" : "no", linear);
+    }
+    
+    printf("\nLinearity (+-%.0f%% up to %.0f%% dead time): %s\n",
+           LINEARITY_TOLERANCE * 100.0, LINEARITY_MAX_DEAD_PERCENT, failures ? "FAIL" : "pass");
+    
+    free(pulses);
+    return failures ? 1 : 0;
+}